@@ -4,19 +4,41 @@
 #include <iostream>
 #include <fstream>
 #include <types.h>
-#include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <sstream>
+#include "aligned.h"
+#include "footprint.h"
+#include "cache.h"
+#include "tlb.h"
+#include "reuse.h"
+#include "simpoint.h"
+#include "tracewriter.h"
+#include "windows.h"
+#include "report.h"
 using std::cerr;
 using std::endl;
 using std::string;
-using std::unordered_set;
+using std::vector;
 
 /* ================================================================== */
 // Global variables
 /* ================================================================== */
 VOID Fini(INT32 code, VOID* v);
+VOID ReportWindow(UINT32 window);
 
 std::ostream* out = &cerr;
+std::ostream* snapshotOut = &cerr;
+ReportFormat reportFormat = REPORT_TEXT;
+SnapshotThread snapshotThread; // -snapshot: progress reports from an internal thread
+PIN_LOCK reportLock; // keeps snapshots away from window reports and resets
 UINT64 fastForward = 0;
+WindowSchedule windowSchedule;
+UINT64 windowStart; // bounds of the current window, cached for the analysis routines
+UINT64 windowEnd;
+BOOL analysisPhase = false; // false while fast-forwarding, true once the window starts
+BOOL windowDone = false; // set after the last window
 
 enum InstructionCategory : UINT64 {
     LOAD,
@@ -38,7 +60,6 @@ enum InstructionCategory : UINT64 {
     OTHER
 };
 
-UINT64 instructionCount = 0;
 UINT64 instructionMetrics[OTHER + 1] = {0};
 
 UINT64 instructionLengthResults[20];
@@ -58,8 +79,316 @@ INT32 minImmediate = INT_MAX;
 ADDRDELTA maxDisplacement = INT_MIN;
 ADDRDELTA minDisplacement = INT_MAX;
 
-unordered_set<UINT64> memoryBlocks;
-unordered_set<UINT64> instructionBlocks;
+// Data and code footprint, tracked at several granularities at once
+const UINT32 footprintGranularities = 3;
+const UINT32 footprintShifts[footprintGranularities] = {5, 6, 12}; // 32 B, 64 B, 4 KB
+FootprintBitmap* memoryFootprint[footprintGranularities];
+FootprintBitmap* instructionFootprint[footprintGranularities];
+
+// Cache hierarchy: split L1 in front of a unified L2 and LLC, all sharing one
+// line size. Data accesses are charged the latency of the level that supplies
+// the line; instruction fetch only pays for L1I misses, since an L1I hit is
+// overlapped with the pipeline. Each thread runs on its own core (see
+// MemoryModel), so only the LLC is shared; the private levels, TLBs,
+// footprints, reuse distances and counters here are the totals over all
+// threads, filled in by MergeMemoryModels for a report.
+UINT32 cacheLineShift;
+UINT32 memoryLatency;
+ReplacementPolicy cachePolicy;
+Cache* l1dCache;
+Cache* l1iCache;
+Cache* l2Cache;
+Cache* llcCache;
+UINT64 dataAccessCycles = 0;
+UINT64 fetchStallCycles = 0;
+UINT64 memoryAccesses = 0;
+
+// Translation is modelled for 4 KB and 2 MB pages side by side, so a single
+// run shows what huge pages would save; -page_size picks the one whose
+// cycles go into the CPI. Crossings count data accesses whose bytes span two
+// cache lines or two pages.
+const UINT32 pageSizes = 2;
+const UINT32 pageShifts[pageSizes] = {12, 21};
+const char* pageSizeNames[pageSizes] = {"4 KB", "2 MB"};
+TlbHierarchy* tlbs[pageSizes];
+TlbGeometry tlbGeometries[pageSizes][3]; // ITLB, DTLB and STLB of each page size
+UINT32 cpiPageSize; // index into tlbs
+UINT64 translationCycles = 0;
+UINT64 lineCrossings = 0;
+UINT64 pageCrossings[pageSizes] = {0};
+
+// LRU stack distances of data accesses at 64 B block granularity, measured
+// on each thread's own stream like its private caches see it
+const UINT32 reuseBlockShift = 6;
+ReuseDistance* blockReuse;
+
+PIN_LOCK llcLock; // the LLC is the only level shared between threads
+
+// A thread's share of a routine's memory statistics
+struct RoutineMemory {
+    UINT64 dataAccessCycles = 0;
+    UINT64 fetchStallCycles = 0;
+    UINT64 translationCycles = 0;
+    FootprintBitmap* dataFootprint = NULL; // 64 B blocks, allocated on first access
+};
+
+// Private L1I, L1D, L2 and TLBs of one thread, with everything measured from
+// its memory buffer. Only the owning thread updates it, so processing a
+// buffer takes no shared lock except llcLock on L2 misses; the lock here is
+// uncontended unless a snapshot is merging the model at the same time.
+struct MemoryModel {
+    PIN_LOCK lock;
+    Cache* l1dCache = NULL;
+    Cache* l1iCache = NULL;
+    Cache* l2Cache = NULL;
+    TlbHierarchy* tlbs[pageSizes] = {NULL};
+    FootprintBitmap* footprint[footprintGranularities] = {NULL};
+    ReuseDistance* reuse = NULL;
+    UINT64 dataAccessCycles = 0;
+    UINT64 fetchStallCycles = 0;
+    UINT64 memoryAccesses = 0;
+    UINT64 maxMemBytes = 0;
+    UINT64 totalMemBytes = 0;
+    UINT64 translationCycles = 0;
+    UINT64 lineCrossings = 0;
+    UINT64 pageCrossings[pageSizes] = {0};
+    vector<RoutineMemory> routines; // by routine id, grown on demand
+
+    RoutineMemory& Routine(UINT32 id) {
+        if (id >= routines.size()) {
+            routines.resize(std::max<size_t>(2 * routines.size(), id + 1));
+        }
+        return routines[id];
+    }
+};
+
+struct DataflowInfo;
+
+// Everything about an instruction except its effective addresses is known at
+// instrumentation time. Each basic block keeps one summary per instruction and
+// a single execution counter; the histograms are rebuilt from them in Fini.
+struct InstructionSummary {
+    UINT64 predicatedCount; // executions with a true predicate (predicated instructions only)
+    UINT32 predicatedId;    // index into predicatedSummaries and ThreadData::predicatedCounts
+    UINT32 firstLoadId;     // index into loadProfiles of the first read operand
+    DataflowInfo* dataflow; // -dataflow only
+    ADDRINT address;
+    InstructionCategory category;
+    BOOL isPredicated;
+    UINT32 length;
+    UINT32 operandCount;
+    UINT32 regReadCount;
+    UINT32 regWriteCount;
+    UINT32 loadSize;
+    UINT32 storeSize;
+    UINT32 memReadCount;
+    UINT32 memWriteCount;
+    UINT32 isMemOp;
+    INT32 minImm;
+    INT32 maxImm;
+    ADDRDELTA minDisp;
+    ADDRDELTA maxDisp;
+};
+
+struct BblSummary {
+    UINT64 count;
+    UINT32 id; // index into bblSummaries and ThreadData::bblCounts
+    UINT32 routineId; // index into routineProfiles
+    UINT32 numIns;
+    UINT32 size;
+    InstructionSummary* instructions;
+};
+
+// Summaries outlive the code cache: a block instrumented again, after a
+// window change flushed the cache or in another trace, finds its summary by
+// address and shape and keeps its id, counters and load profiles. Code still
+// in the cache may count into any of them, so none is ever freed; an address
+// holds one summary per distinct shape it has had.
+vector<BblSummary*> bblSummaries;
+std::unordered_multimap<ADDRINT, BblSummary*> bblSummaryCache;
+vector<InstructionSummary*> predicatedSummaries;
+
+// Register dataflow. Each executed instruction looks up the last writer of
+// every register it reads in a flat table indexed by REG, giving the
+// dependency distance in dynamic instructions. For each window size the
+// same stream is scheduled on an ideal machine with unit latency, unlimited
+// width and in-order retirement: an instruction may issue once its source
+// registers are ready and the instruction `window` places earlier has
+// retired. Memory dependencies are not modelled, so the ILP is an upper bound.
+const UINT32 MAX_DATAFLOW_REGS = 8;
+const UINT32 dependencyBins = 32;
+
+struct DataflowInfo {
+    UINT32 numReads;
+    UINT32 numWrites;
+    REG reads[MAX_DATAFLOW_REGS];
+    REG writes[MAX_DATAFLOW_REGS];
+};
+
+struct IlpWindow {
+    UINT32 size;
+    UINT64 lastRetire;
+    vector<UINT64> retire; // ring buffer of retire times, one slot per window entry
+    vector<UINT64> ready;  // cycle in which each register's value is available
+};
+
+struct DataflowState {
+    UINT64 instructions = 0;
+    UINT64 registerReads = 0;
+    UINT64 unproducedReads = 0; // reads of registers not written since the window started
+    UINT64 dependencyHistogram[dependencyBins] = {0};
+    vector<UINT64> lastWriter = vector<UINT64>(REG_LAST + 1, 0); // dynamic index, 0 if never written
+    vector<IlpWindow> windows;
+};
+
+vector<UINT32> ilpWindowSizes;
+
+// One thread's view of a load, for the stride profiler (see LoadProfile)
+struct LoadStride {
+    ADDRINT lastAddress;
+    INT64 stride;
+    UINT32 confidence;
+    UINT64 executions;
+    UINT64 strideHits;
+    UINT64 l1dMisses;
+};
+
+// Per-thread counters indexed by summary id. Storage comes in fixed chunks
+// that never move; Trace reserves them for every thread before the code
+// using the new ids can run, so the analysis routines index without a
+// bounds check while other threads keep counting.
+class ThreadCounters {
+  public:
+    static const UINT32 CHUNK_SHIFT = 12;
+    static const UINT32 CHUNK_SIZE = 1 << CHUNK_SHIFT;
+    static const UINT32 MAX_CHUNKS = 1 << 12;
+
+    ThreadCounters() : chunks(), numChunks(0) {}
+    ~ThreadCounters() {
+        for (UINT32 i = 0; i < numChunks; i++) {
+            delete[] chunks[i];
+        }
+    }
+
+    UINT64& operator[](UINT32 id) { return chunks[id >> CHUNK_SHIFT][id & (CHUNK_SIZE - 1)]; }
+    UINT32 Size() const { return numChunks * CHUNK_SIZE; }
+
+    VOID Reserve(UINT32 size) {
+        while (Size() < size) {
+            ASSERT(numChunks < MAX_CHUNKS, "too many instrumented blocks for the per-thread counters");
+            chunks[numChunks++] = new UINT64[CHUNK_SIZE]();
+        }
+    }
+
+    VOID Clear() {
+        for (UINT32 i = 0; i < numChunks; i++) {
+            std::fill(chunks[i], chunks[i] + CHUNK_SIZE, 0);
+        }
+    }
+
+  private:
+    UINT64* chunks[MAX_CHUNKS];
+    UINT32 numChunks;
+};
+
+// Dynamic counters are kept per application thread and folded into the
+// summaries in Fini. ThreadData is cache-line aligned so that two threads'
+// counters never share a line.
+//
+// Windows are global: the bounds are checked against the running thread's
+// own instruction count, the window opens for every thread as soon as one
+// thread reaches its start, and it closes when one reaches its end. HW2
+// uses the same definition.
+struct ThreadData : CacheAligned {
+    UINT64 instructionCount = 0;
+    UINT64 windowInstructions = 0;
+    ThreadCounters bblCounts;
+    ThreadCounters predicatedCounts;
+    DataflowState dataflow;
+    vector<LoadStride> loadStrides; // per load id, filled from this thread's memory buffer
+    MemoryModel memory;
+    VOID* bufferStart; // first record of this thread's memory buffer
+};
+
+TLS_KEY threadDataKey;
+PIN_LOCK threadListLock;
+vector<ThreadData*> threadList;
+
+// Effective addresses are appended to a per-thread Pin trace buffer and
+// processed a whole buffer at a time
+enum MemoryAccessFlags : UINT32 {
+    MEMORY_READ = 1,
+    MEMORY_WRITE = 2,
+    MEMORY_FETCH = 4 // one record per executed basic block, covering its bytes
+};
+
+struct MemoryRecord {
+    ADDRINT address;
+    UINT32 size;
+    UINT32 flags;
+    UINT32 loadId; // index into loadProfiles, or NO_LOAD_PROFILE
+    UINT32 routineId; // index into routineProfiles
+    UINT32 window; // window the code was instrumented for; stale records are dropped
+};
+
+// Per static load operand: stride detection and L1D misses, updated from the
+// memory buffer. Each thread detects strides in its own address stream, so
+// interleaved threads do not break each other's patterns: a stride is
+// adopted once it repeats, and dropped after the confidence counter decays
+// to zero. The report shows the stride most executions followed.
+const UINT32 NO_LOAD_PROFILE = ~0U;
+
+enum LoadClass {
+    CONSTANT_STRIDE,
+    POINTER_CHASING,
+    IRREGULAR
+};
+
+struct LoadProfile {
+    ADDRINT address;
+    BOOL baseIsDestination; // the load overwrites its own base register
+    INT64 stride; // dominant stride, set when the profiles are merged
+    UINT64 executions;
+    UINT64 strideHits;
+    UINT64 l1dMisses;
+};
+
+vector<LoadProfile*> loadProfiles;
+
+// Per routine results. The routine of each basic block is resolved once at
+// instrumentation time and its index is baked into the block summary and the
+// memory records, so attribution costs nothing at run time: the instruction
+// mix comes from the block counts in Fini, and cache cycles and the data
+// footprint from the memory buffer. Id 0 collects code without symbols.
+struct RoutineProfile {
+    string name;
+    string image;
+    UINT64 instructions;
+    UINT64 metrics[OTHER + 1];
+    UINT64 memoryOperations;
+    UINT64 dataAccessCycles;
+    UINT64 fetchStallCycles;
+    UINT64 translationCycles; // TLB misses of the page size in the CPI model
+    FootprintBitmap* dataFootprint; // 64 B blocks, allocated on first access
+    FootprintBitmap* codeFootprint;
+};
+
+// SimPoint mode (-bbv): instead of analysing one window, the whole run of the
+// main thread is cut into fixed-length intervals and each interval's basic
+// block vector (instructions executed per block) is written in SimPoint's .bb
+// format, then clustered into representative intervals at exit.
+std::unordered_map<ADDRINT, UINT32> bbvIds; // block address to SimPoint id, from 1
+vector<UINT64> bbvCounts;
+UINT64 bbvInstructions = 0;
+UINT64 bbvInterval;
+std::ofstream* bbvOut;
+SimPointClustering simPointClustering;
+
+vector<RoutineProfile*> routineProfiles;
+std::unordered_map<ADDRINT, UINT32> routineIds; // routine address to index
+
+BUFFER_ID memoryBuffer;
+TraceRecorder traceRecorder; // -trace: binary trace of the analysis window
 
 /* ===================================================================== */
 // Command line switches
@@ -67,61 +396,581 @@ unordered_set<UINT64> instructionBlocks;
 KNOB<string> KnobOutputFile(KNOB_MODE_WRITEONCE, "pintool", "o", "", "specify file name for MyPinTool output");
 KNOB<BOOL> KnobCount(KNOB_MODE_WRITEONCE, "pintool", "count", "1", "count instructions, basic blocks and threads in the application");
 KNOB<UINT64> KnobFastForward(KNOB_MODE_WRITEONCE, "pintool", "f", "0", "fast forward to the specified instruction count");
+KNOB<UINT64> KnobWindowLength(KNOB_MODE_WRITEONCE, "pintool", "window_length", "1000000000", "instructions in each analysis window");
+KNOB<string> KnobWindows(KNOB_MODE_WRITEONCE, "pintool", "windows", "", "comma-separated analysis windows as start[:length] in instructions, e.g. 2e9:5e8,1e10");
+KNOB<UINT64> KnobEvery(KNOB_MODE_WRITEONCE, "pintool", "every", "0", "start a window every N instructions from -f onwards (0: a single window)");
+KNOB<string> KnobFormat(KNOB_MODE_WRITEONCE, "pintool", "format", "text", "output format: text, json (one object per line) or csv");
+KNOB<UINT64> KnobSnapshot(KNOB_MODE_WRITEONCE, "pintool", "snapshot", "0", "write a progress snapshot every N instructions (0: off)");
+KNOB<string> KnobSnapshotFile(KNOB_MODE_WRITEONCE, "pintool", "snapshot_file", "", "file for the snapshots, default the -o output");
+KNOB<UINT32> KnobBufferPages(KNOB_MODE_WRITEONCE, "pintool", "buffer_pages", "256", "number of 4 KB pages in each thread's memory-address buffer");
+KNOB<BOOL> KnobDetach(KNOB_MODE_WRITEONCE, "pintool", "detach", "0", "detach from the application after the last analysis window instead of exiting");
+KNOB<UINT32> KnobCacheLine(KNOB_MODE_WRITEONCE, "pintool", "cache_line", "64", "cache line size in bytes, shared by all levels");
+KNOB<string> KnobCachePolicy(KNOB_MODE_WRITEONCE, "pintool", "cache_policy", "lru", "cache replacement policy: lru, plru or rrip");
+KNOB<UINT32> KnobL1DSize(KNOB_MODE_WRITEONCE, "pintool", "l1d_size", "32", "L1 data cache size in KB");
+KNOB<UINT32> KnobL1DAssoc(KNOB_MODE_WRITEONCE, "pintool", "l1d_assoc", "8", "L1 data cache associativity");
+KNOB<UINT32> KnobL1DLatency(KNOB_MODE_WRITEONCE, "pintool", "l1d_latency", "1", "L1 data cache hit latency in cycles");
+KNOB<UINT32> KnobL1ISize(KNOB_MODE_WRITEONCE, "pintool", "l1i_size", "32", "L1 instruction cache size in KB");
+KNOB<UINT32> KnobL1IAssoc(KNOB_MODE_WRITEONCE, "pintool", "l1i_assoc", "8", "L1 instruction cache associativity");
+KNOB<UINT32> KnobL1ILatency(KNOB_MODE_WRITEONCE, "pintool", "l1i_latency", "1", "L1 instruction cache hit latency in cycles");
+KNOB<UINT32> KnobL2Size(KNOB_MODE_WRITEONCE, "pintool", "l2_size", "256", "L2 cache size in KB");
+KNOB<UINT32> KnobL2Assoc(KNOB_MODE_WRITEONCE, "pintool", "l2_assoc", "8", "L2 cache associativity");
+KNOB<UINT32> KnobL2Latency(KNOB_MODE_WRITEONCE, "pintool", "l2_latency", "10", "L2 cache hit latency in cycles");
+KNOB<UINT32> KnobLLCSize(KNOB_MODE_WRITEONCE, "pintool", "llc_size", "8192", "last-level cache size in KB");
+KNOB<UINT32> KnobLLCAssoc(KNOB_MODE_WRITEONCE, "pintool", "llc_assoc", "16", "last-level cache associativity");
+KNOB<UINT32> KnobLLCLatency(KNOB_MODE_WRITEONCE, "pintool", "llc_latency", "30", "last-level cache hit latency in cycles");
+KNOB<BOOL> KnobDataflow(KNOB_MODE_WRITEONCE, "pintool", "dataflow", "0", "measure register dependency distances and the ILP limit");
+KNOB<string> KnobIlpWindows(KNOB_MODE_WRITEONCE, "pintool", "ilp_windows", "32,64,128,256,512", "comma-separated instruction window sizes for the ILP limit");
+KNOB<string> KnobTrace(KNOB_MODE_WRITEONCE, "pintool", "trace", "", "record a binary trace of the analysis window to <prefix>.static and <prefix>.<tid>.trace");
+KNOB<BOOL> KnobBbv(KNOB_MODE_WRITEONCE, "pintool", "bbv", "0", "collect SimPoint basic block vectors over the whole run instead of analysing a window");
+KNOB<UINT64> KnobBbvInterval(KNOB_MODE_WRITEONCE, "pintool", "bbv_interval", "100000000", "instructions per basic block vector interval");
+KNOB<string> KnobBbvPrefix(KNOB_MODE_WRITEONCE, "pintool", "bbv_prefix", "hw1", "prefix of the .bb, .simpoints and .weights files");
+KNOB<UINT32> KnobMaxK(KNOB_MODE_WRITEONCE, "pintool", "maxk", "10", "maximum number of SimPoint clusters");
+KNOB<UINT32> KnobTopRoutines(KNOB_MODE_WRITEONCE, "pintool", "top_routines", "10", "number of routines and images in the hotspot report");
+KNOB<UINT32> KnobTopLoads(KNOB_MODE_WRITEONCE, "pintool", "top_loads", "20", "number of static loads reported by the stride profiler");
+KNOB<UINT32> KnobItlbEntries(KNOB_MODE_WRITEONCE, "pintool", "itlb_entries", "128", "first-level instruction TLB entries for 4 KB pages");
+KNOB<UINT32> KnobItlbAssoc(KNOB_MODE_WRITEONCE, "pintool", "itlb_assoc", "8", "first-level instruction TLB associativity for 4 KB pages");
+KNOB<UINT32> KnobDtlbEntries(KNOB_MODE_WRITEONCE, "pintool", "dtlb_entries", "64", "first-level data TLB entries for 4 KB pages");
+KNOB<UINT32> KnobDtlbAssoc(KNOB_MODE_WRITEONCE, "pintool", "dtlb_assoc", "4", "first-level data TLB associativity for 4 KB pages");
+KNOB<UINT32> KnobStlbEntries(KNOB_MODE_WRITEONCE, "pintool", "stlb_entries", "1024", "second-level TLB entries for 4 KB pages");
+KNOB<UINT32> KnobStlbAssoc(KNOB_MODE_WRITEONCE, "pintool", "stlb_assoc", "8", "second-level TLB associativity for 4 KB pages");
+KNOB<UINT32> KnobItlb2mEntries(KNOB_MODE_WRITEONCE, "pintool", "itlb_2m_entries", "8", "first-level instruction TLB entries for 2 MB pages");
+KNOB<UINT32> KnobItlb2mAssoc(KNOB_MODE_WRITEONCE, "pintool", "itlb_2m_assoc", "8", "first-level instruction TLB associativity for 2 MB pages");
+KNOB<UINT32> KnobDtlb2mEntries(KNOB_MODE_WRITEONCE, "pintool", "dtlb_2m_entries", "32", "first-level data TLB entries for 2 MB pages");
+KNOB<UINT32> KnobDtlb2mAssoc(KNOB_MODE_WRITEONCE, "pintool", "dtlb_2m_assoc", "4", "first-level data TLB associativity for 2 MB pages");
+KNOB<UINT32> KnobStlb2mEntries(KNOB_MODE_WRITEONCE, "pintool", "stlb_2m_entries", "1024", "second-level TLB entries for 2 MB pages");
+KNOB<UINT32> KnobStlb2mAssoc(KNOB_MODE_WRITEONCE, "pintool", "stlb_2m_assoc", "8", "second-level TLB associativity for 2 MB pages");
+KNOB<UINT32> KnobStlbLatency(KNOB_MODE_WRITEONCE, "pintool", "stlb_latency", "7", "second-level TLB hit latency in cycles");
+KNOB<UINT32> KnobWalkLatency(KNOB_MODE_WRITEONCE, "pintool", "walk_latency", "30", "page walk latency in cycles");
+KNOB<string> KnobPageSize(KNOB_MODE_WRITEONCE, "pintool", "page_size", "4k", "page size charged in the CPI model: 4k or 2m (both are reported)");
+KNOB<UINT32> KnobMemoryLatency(KNOB_MODE_WRITEONCE, "pintool", "mem_latency", "69", "main memory latency in cycles");
 
 /* ===================================================================== */
 // Instrumentation callbacks
 /* ===================================================================== */
-UINT32 CheckTerminate() { return instructionCount >= fastForward + 1'000'000'000; }
-UINT32 CheckFastForward() { return instructionCount >= fastForward && instructionCount < fastForward + 1'000'000'000; }
-
-VOID CountInstruction(UINT32 count) { instructionCount += count; }
-
-VOID MemoryBlockAnalysis(ADDRINT address, UINT32 size) {
-    maxMemBytes = (size > maxMemBytes) ? size : maxMemBytes;
-    totalMemBytes += size;
-    for (UINT64 block = (address >> 5); block < ((address + size + 31) >> 5); block++) {
-        memoryBlocks.insert(block);
-    }
-}
-
-VOID PredicatedInstructionAnalysis(
-    InstructionCategory category,
-    UINT64 loadSize,
-    UINT64 storeSize,
-    UINT64 memReadCount,
-    UINT64 memWriteCount,
-    ADDRDELTA minDisp,
-    ADDRDELTA maxDisp,
-    UINT64 isMemOp
-) {
-    instructionMetrics[category]++;
-    instructionMetrics[LOAD] += loadSize;
-    instructionMetrics[STORE] += storeSize;
-    memOperandCountResults[memReadCount + memWriteCount]++;
-    memReadCountResults[memReadCount] += isMemOp;
-    memWriteCountResults[memWriteCount] += isMemOp;
-    minDisplacement = (minDisp < minDisplacement) ? minDisp : minDisplacement;
-    maxDisplacement = (maxDisp > maxDisplacement) ? maxDisp : maxDisplacement;
-}
-
-VOID InstructionAnalysis(
-    UINT64 instructionLength,
-    ADDRINT instructionPointer,
-    UINT64 operandCount,
-    UINT64 regReadCount,
-    UINT64 regWriteCount,
-    INT32 minImm,
-    INT32 maxImm
-) {
-    instructionLengthResults[instructionLength]++;
-    operandCountResults[operandCount]++;
-    regReadCountResults[regReadCount]++;
-    regWriteCountResults[regWriteCount]++;
-    maxImmediate = (maxImm > maxImmediate) ? maxImm : maxImmediate;
-    minImmediate = (minImm < minImmediate) ? minImm : minImmediate;
-
-    for (UINT64 block = (instructionPointer >> 5); block < ((instructionPointer + instructionLength + 31) >> 5); block++) {
-        instructionBlocks.insert(block);
+inline ThreadData* GetThreadData(THREADID tid) { return static_cast<ThreadData*>(PIN_GetThreadData(threadDataKey, tid)); }
+
+VOID ResetStatistics();
+
+// Fast-forward is done: clear the previous window's results and drop the
+// counting-only code from the code cache so every trace is re-instrumented
+// with the full analysis calls. The other threads are stopped so none of
+// them is inside an analysis routine while the statistics are reset; if
+// another thread is already stopping the world, this one just retries at
+// its next block.
+VOID EnterAnalysisPhase(THREADID tid) {
+    if (!PIN_StopApplicationThreads(tid, PIN_INFINITE_TIMEOUT)) {
+        return;
+    }
+    BOOL entered = !analysisPhase && !windowDone;
+    if (entered) {
+        PIN_GetLock(&reportLock, tid + 1);
+        ResetStatistics();
+        analysisPhase = true;
+        PIN_ReleaseLock(&reportLock);
+    }
+    PIN_ResumeApplicationThreads(tid);
+    if (entered) {
+        PIN_RemoveInstrumentation();
+    }
+}
+
+// Counts the block and tells the Then call whether the window is over
+UINT32 CountBblAndCheckTerminate(THREADID tid, UINT32 id, UINT32 numIns) {
+    ThreadData* data = GetThreadData(tid);
+    data->bblCounts[id]++;
+    data->instructionCount += numIns;
+    data->windowInstructions += numIns;
+    return data->instructionCount >= windowEnd;
+}
+
+UINT32 CountAndCheckFastForward(THREADID tid, UINT32 count) {
+    ThreadData* data = GetThreadData(tid);
+    data->instructionCount += count;
+    return data->instructionCount >= windowStart;
+}
+
+UINT32 CountBbv(THREADID tid, UINT32 id, UINT32 numIns) {
+    if (tid != 0) {
+        return 0;
+    }
+    if (id >= bbvCounts.size()) {
+        bbvCounts.resize(std::max<size_t>(2 * bbvCounts.size(), id + 1), 0);
+    }
+    bbvCounts[id] += numIns;
+    bbvInstructions += numIns;
+    return bbvInstructions >= bbvInterval;
+}
+
+VOID EndBbvInterval() {
+    BasicBlockVector bbv;
+    *bbvOut << "T";
+    for (UINT32 id = 0; id < bbvCounts.size(); id++) {
+        if (bbvCounts[id]) {
+            *bbvOut << ":" << id << ":" << bbvCounts[id] << " ";
+            bbv.push_back(std::make_pair(id, bbvCounts[id]));
+            bbvCounts[id] = 0;
+        }
+    }
+    *bbvOut << endl;
+    simPointClustering.AddInterval(bbv);
+    bbvInstructions = 0;
+}
+
+VOID CountPredicated(THREADID tid, UINT32 id) { GetThreadData(tid)->predicatedCounts[id]++; }
+
+// Returns the latency of the level that supplied the line
+UINT32 AccessHierarchy(MemoryModel& model, Cache* l1, UINT64 line) {
+    if (l1->Access(line)) {
+        return l1->Latency();
+    }
+    if (model.l2Cache->Access(line)) {
+        return model.l2Cache->Latency();
+    }
+    PIN_GetLock(&llcLock, PIN_ThreadId() + 1);
+    BOOL hit = llcCache->Access(line);
+    PIN_ReleaseLock(&llcLock);
+    return hit ? llcCache->Latency() : memoryLatency;
+}
+
+// Feeds both page sizes; returns the cycles of the one in the CPI model
+UINT32 Translate(MemoryModel& model, BOOL instruction, ADDRINT address, UINT32 size) {
+    UINT32 cycles = 0;
+    for (UINT32 i = 0; i < pageSizes; i++) {
+        UINT32 spent = model.tlbs[i]->Access(instruction, address, size);
+        cycles = (i == cpiPageSize) ? spent : cycles;
+    }
+    model.translationCycles += cycles;
+    return cycles;
+}
+
+VOID ProfileLoad(LoadStride& state, ADDRINT address, UINT32 l1dMisses) {
+    INT64 delta = (INT64) (address - state.lastAddress);
+    if (state.executions > 0) {
+        if (delta == state.stride) {
+            state.strideHits++;
+            state.confidence += (state.confidence < 3);
+        } else if (state.confidence > 0) {
+            state.confidence--;
+        } else {
+            state.stride = delta;
+        }
+    }
+    state.lastAddress = address;
+    state.executions++;
+    state.l1dMisses += l1dMisses;
+}
+
+LoadClass ClassifyLoad(const LoadProfile* load) {
+    if (load->strideHits * 4 >= load->executions * 3) {
+        return CONSTANT_STRIDE;
+    }
+    return load->baseIsDestination ? POINTER_CHASING : IRREGULAR;
+}
+
+// Bin 0 is unused; bin k holds distances in [2^(k-1), 2^k)
+inline UINT32 DistanceBin(UINT64 distance) {
+    UINT32 bin = 0;
+    while (distance && bin < dependencyBins - 1) {
+        distance >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+VOID Dataflow(THREADID tid, const DataflowInfo* info) {
+    DataflowState& state = GetThreadData(tid)->dataflow;
+    UINT64 n = ++state.instructions;
+
+    state.registerReads += info->numReads;
+    for (UINT32 i = 0; i < info->numReads; i++) {
+        UINT64 producer = state.lastWriter[info->reads[i]];
+        if (producer) {
+            state.dependencyHistogram[DistanceBin(n - producer)]++;
+        } else {
+            state.unproducedReads++;
+        }
+    }
+
+    for (IlpWindow& window : state.windows) {
+        UINT64& slot = window.retire[n % window.size]; // retire time of instruction n - size
+        UINT64 issue = slot;
+        for (UINT32 i = 0; i < info->numReads; i++) {
+            issue = std::max(issue, window.ready[info->reads[i]]);
+        }
+        UINT64 complete = issue + 1;
+        for (UINT32 i = 0; i < info->numWrites; i++) {
+            window.ready[info->writes[i]] = complete;
+        }
+        window.lastRetire = std::max(window.lastRetire, complete);
+        slot = window.lastRetire;
+    }
+
+    for (UINT32 i = 0; i < info->numWrites; i++) {
+        state.lastWriter[info->writes[i]] = n;
+    }
+}
+
+// Records filled by code instrumented for an earlier window can still sit in
+// a thread's buffer when the next window starts
+inline BOOL CurrentWindow(const MemoryRecord& record) { return analysisPhase && !windowDone && record.window == windowSchedule.Index(); }
+
+VOID ProcessMemoryRecords(THREADID tid, const MemoryRecord* records, UINT64 numElements) {
+    ThreadData* data = GetThreadData(tid);
+    MemoryModel& model = data->memory;
+    vector<LoadStride>& loadStrides = data->loadStrides;
+    PIN_GetLock(&model.lock, tid + 1);
+    for (UINT64 r = 0; r < numElements; r++) {
+        if (!CurrentWindow(records[r])) {
+            continue;
+        }
+        ADDRINT address = records[r].address;
+        UINT32 size = records[r].size;
+        UINT64 firstLine = address >> cacheLineShift;
+        UINT64 lastLine = (address + (size ? size - 1 : 0)) >> cacheLineShift;
+        RoutineMemory& routine = model.Routine(records[r].routineId);
+        if (records[r].flags & MEMORY_FETCH) {
+            routine.translationCycles += Translate(model, true, address, size);
+            for (UINT64 line = firstLine; line <= lastLine; line++) {
+                UINT32 stall = AccessHierarchy(model, model.l1iCache, line) - model.l1iCache->Latency();
+                model.fetchStallCycles += stall;
+                routine.fetchStallCycles += stall;
+            }
+            continue;
+        }
+        model.maxMemBytes = (size > model.maxMemBytes) ? size : model.maxMemBytes;
+        model.totalMemBytes += size;
+        model.memoryAccesses++;
+        routine.translationCycles += Translate(model, false, address, size);
+        model.lineCrossings += (firstLine != lastLine);
+        for (UINT32 i = 0; i < pageSizes; i++) {
+            model.pageCrossings[i] += (address >> pageShifts[i]) != ((address + (size ? size - 1 : 0)) >> pageShifts[i]);
+        }
+        UINT32 l1dMisses = 0;
+        for (UINT64 line = firstLine; line <= lastLine; line++) {
+            UINT32 latency = AccessHierarchy(model, model.l1dCache, line);
+            model.dataAccessCycles += latency;
+            routine.dataAccessCycles += latency;
+            l1dMisses += (latency > model.l1dCache->Latency());
+        }
+        if (routine.dataFootprint == NULL) {
+            routine.dataFootprint = new FootprintBitmap(6);
+        }
+        routine.dataFootprint->Touch(address, size);
+        UINT32 loadId = records[r].loadId;
+        if (loadId != NO_LOAD_PROFILE) {
+            if (loadId >= loadStrides.size()) {
+                loadStrides.resize(std::max<size_t>(2 * loadStrides.size(), loadId + 1), LoadStride());
+            }
+            ProfileLoad(loadStrides[loadId], address, l1dMisses);
+        }
+        UINT64 lastBlock = (address + (size ? size - 1 : 0)) >> reuseBlockShift;
+        for (UINT64 block = address >> reuseBlockShift; block <= lastBlock; block++) {
+            model.reuse->Access(block);
+        }
+    }
+    for (UINT32 i = 0; i < footprintGranularities; i++) {
+        FootprintBitmap* footprint = model.footprint[i];
+        for (UINT64 r = 0; r < numElements; r++) {
+            if (!(records[r].flags & MEMORY_FETCH) && CurrentWindow(records[r])) {
+                footprint->Touch(records[r].address, records[r].size);
+            }
+        }
+    }
+    PIN_ReleaseLock(&model.lock);
+}
+
+// Called by Pin whenever a thread's buffer fills up, and at thread exit
+VOID* ProcessMemoryBuffer(BUFFER_ID id, THREADID tid, const CONTEXT* ctxt, VOID* buffer, UINT64 numElements, VOID* v) {
+    ProcessMemoryRecords(tid, (const MemoryRecord*) buffer, numElements);
+    return buffer;
+}
+
+// Processes what a thread has filled into its memory buffer so far
+VOID DrainMemoryBuffer(THREADID tid, CONTEXT* ctxt) {
+    const MemoryRecord* start = (const MemoryRecord*) GetThreadData(tid)->bufferStart;
+    const MemoryRecord* end = (const MemoryRecord*) PIN_GetBufferPointer(ctxt, memoryBuffer);
+    ProcessMemoryRecords(tid, start, end - start);
+}
+
+// Called when a window ends, with every other thread stopped. The records
+// stay in the buffers and are dropped as stale when Pin flushes them later.
+VOID DrainMemoryBuffers(THREADID tid, CONTEXT* ctxt) {
+    DrainMemoryBuffer(tid, ctxt);
+    for (UINT32 i = 0; i < PIN_GetStoppedThreadCount(); i++) {
+        THREADID thread = PIN_GetStoppedThreadId(i);
+        DrainMemoryBuffer(thread, PIN_GetStoppedThreadWriteableContext(thread));
+    }
+}
+
+// Contribution of an instruction whose predicate was true `count` times
+VOID AccumulatePredicated(const InstructionSummary& ins, UINT64 count) {
+    instructionMetrics[ins.category] += count;
+    instructionMetrics[LOAD] += count * ins.loadSize;
+    instructionMetrics[STORE] += count * ins.storeSize;
+    memOperandCountResults[ins.memReadCount + ins.memWriteCount] += count;
+    memReadCountResults[ins.memReadCount] += count * ins.isMemOp;
+    memWriteCountResults[ins.memWriteCount] += count * ins.isMemOp;
+    minDisplacement = (ins.minDisp < minDisplacement) ? ins.minDisp : minDisplacement;
+    maxDisplacement = (ins.maxDisp > maxDisplacement) ? ins.maxDisp : maxDisplacement;
+}
+
+// Contribution of an instruction that was executed `count` times
+VOID AccumulateInstruction(const InstructionSummary& ins, UINT64 count) {
+    instructionLengthResults[ins.length] += count;
+    operandCountResults[ins.operandCount] += count;
+    regReadCountResults[ins.regReadCount] += count;
+    regWriteCountResults[ins.regWriteCount] += count;
+    maxImmediate = (ins.maxImm > maxImmediate) ? ins.maxImm : maxImmediate;
+    minImmediate = (ins.minImm < minImmediate) ? ins.minImm : minImmediate;
+
+    for (UINT32 i = 0; i < footprintGranularities; i++) {
+        instructionFootprint[i]->Touch(ins.address, ins.length);
+    }
+}
+
+// Folds every thread's counters into the shared summaries
+UINT64 MergeThreadCounts() {
+    UINT64 instructionCount = 0;
+    PIN_GetLock(&threadListLock, 0);
+    for (ThreadData* data : threadList) {
+        instructionCount += data->windowInstructions;
+        for (UINT32 id = 0; id < bblSummaries.size(); id++) {
+            bblSummaries[id]->count += data->bblCounts[id];
+        }
+        for (UINT32 id = 0; id < predicatedSummaries.size(); id++) {
+            predicatedSummaries[id]->predicatedCount += data->predicatedCounts[id];
+        }
+    }
+    PIN_ReleaseLock(&threadListLock);
+    return instructionCount;
+}
+
+VOID AccumulateRoutine(RoutineProfile* routine, const InstructionSummary& ins, UINT64 count, UINT64 predicatedCount) {
+    routine->instructions += count;
+    routine->metrics[ins.category] += predicatedCount;
+    routine->metrics[LOAD] += predicatedCount * ins.loadSize;
+    routine->metrics[STORE] += predicatedCount * ins.storeSize;
+    routine->memoryOperations += predicatedCount * (ins.memReadCount + ins.memWriteCount);
+    if (routine->codeFootprint == NULL) {
+        routine->codeFootprint = new FootprintBitmap(6);
+    }
+    routine->codeFootprint->Touch(ins.address, ins.length);
+}
+
+VOID AccumulateBblSummaries() {
+    for (BblSummary* bbl : bblSummaries) {
+        if (bbl->count == 0) {
+            continue;
+        }
+        RoutineProfile* routine = routineProfiles[bbl->routineId];
+        for (UINT32 i = 0; i < bbl->numIns; i++) {
+            const InstructionSummary& ins = bbl->instructions[i];
+            AccumulateInstruction(ins, bbl->count);
+            UINT64 predicatedCount = ins.isPredicated ? ins.predicatedCount : bbl->count;
+            if (predicatedCount > 0) {
+                AccumulatePredicated(ins, predicatedCount);
+            }
+            AccumulateRoutine(routine, ins, bbl->count, predicatedCount);
+        }
+    }
+}
+
+VOID CreateTlbs(TlbHierarchy** hierarchies) {
+    for (UINT32 i = 0; i < pageSizes; i++) {
+        const TlbGeometry* geometry = tlbGeometries[i];
+        delete hierarchies[i];
+        hierarchies[i] = new TlbHierarchy(pageShifts[i], geometry[0], geometry[1], geometry[2], KnobStlbLatency.Value(), KnobWalkLatency.Value());
+    }
+}
+
+// The levels private to a core, or their totals
+VOID CreatePrivateCaches(Cache*& l1d, Cache*& l1i, Cache*& l2) {
+    delete l1d;
+    delete l1i;
+    delete l2;
+    l1d = new Cache(KnobL1DSize.Value() * 1024ULL, KnobL1DAssoc.Value(), cacheLineShift, cachePolicy, KnobL1DLatency.Value());
+    l1i = new Cache(KnobL1ISize.Value() * 1024ULL, KnobL1IAssoc.Value(), cacheLineShift, cachePolicy, KnobL1ILatency.Value());
+    l2 = new Cache(KnobL2Size.Value() * 1024ULL, KnobL2Assoc.Value(), cacheLineShift, cachePolicy, KnobL2Latency.Value());
+}
+
+VOID CreateLlc() {
+    delete llcCache;
+    llcCache = new Cache(KnobLLCSize.Value() * 1024ULL, KnobLLCAssoc.Value(), cacheLineShift, cachePolicy, KnobLLCLatency.Value());
+}
+
+// Starts a thread's model from cold caches and TLBs and empty footprints
+VOID ResetMemoryModel(MemoryModel& model) {
+    CreatePrivateCaches(model.l1dCache, model.l1iCache, model.l2Cache);
+    CreateTlbs(model.tlbs);
+    for (UINT32 i = 0; i < footprintGranularities; i++) {
+        delete model.footprint[i];
+        model.footprint[i] = new FootprintBitmap(footprintShifts[i]);
+    }
+    delete model.reuse;
+    model.reuse = new ReuseDistance;
+    model.dataAccessCycles = 0;
+    model.fetchStallCycles = 0;
+    model.memoryAccesses = 0;
+    model.maxMemBytes = 0;
+    model.totalMemBytes = 0;
+    model.translationCycles = 0;
+    model.lineCrossings = 0;
+    std::fill(model.pageCrossings, model.pageCrossings + pageSizes, 0);
+    for (RoutineMemory& routine : model.routines) {
+        delete routine.dataFootprint;
+    }
+    model.routines.clear();
+}
+
+// Sums every thread's memory model into the totals. Runs under reportLock,
+// either with the application stopped or on the snapshot thread while it
+// runs, so each model is read under its own lock.
+VOID MergeMemoryModels() {
+    CreatePrivateCaches(l1dCache, l1iCache, l2Cache);
+    CreateTlbs(tlbs);
+    for (UINT32 i = 0; i < footprintGranularities; i++) {
+        delete memoryFootprint[i];
+        memoryFootprint[i] = new FootprintBitmap(footprintShifts[i]);
+    }
+    delete blockReuse;
+    blockReuse = new ReuseDistance;
+    dataAccessCycles = 0;
+    fetchStallCycles = 0;
+    memoryAccesses = 0;
+    maxMemBytes = 0;
+    totalMemBytes = 0;
+    translationCycles = 0;
+    lineCrossings = 0;
+    std::fill(pageCrossings, pageCrossings + pageSizes, 0);
+
+    PIN_GetLock(&threadListLock, 0);
+    for (ThreadData* data : threadList) {
+        MemoryModel& model = data->memory;
+        PIN_GetLock(&model.lock, PIN_ThreadId() + 1);
+        l1dCache->AddCounts(*model.l1dCache);
+        l1iCache->AddCounts(*model.l1iCache);
+        l2Cache->AddCounts(*model.l2Cache);
+        for (UINT32 i = 0; i < pageSizes; i++) {
+            tlbs[i]->AddCounts(*model.tlbs[i]);
+            pageCrossings[i] += model.pageCrossings[i];
+        }
+        for (UINT32 i = 0; i < footprintGranularities; i++) {
+            memoryFootprint[i]->Merge(*model.footprint[i]);
+        }
+        blockReuse->AddCounts(*model.reuse);
+        dataAccessCycles += model.dataAccessCycles;
+        fetchStallCycles += model.fetchStallCycles;
+        memoryAccesses += model.memoryAccesses;
+        maxMemBytes = std::max(maxMemBytes, model.maxMemBytes);
+        totalMemBytes += model.totalMemBytes;
+        translationCycles += model.translationCycles;
+        lineCrossings += model.lineCrossings;
+        PIN_ReleaseLock(&model.lock);
+    }
+    PIN_ReleaseLock(&threadListLock);
+}
+
+// The per-routine part of the merge, for window reports only: instrumentation
+// adds routines while the application runs
+VOID MergeRoutineMemory() {
+    for (RoutineProfile* routine : routineProfiles) {
+        routine->dataAccessCycles = 0;
+        routine->fetchStallCycles = 0;
+        routine->translationCycles = 0;
+        delete routine->dataFootprint;
+        routine->dataFootprint = NULL;
+    }
+    PIN_GetLock(&threadListLock, 0);
+    for (const ThreadData* data : threadList) {
+        const vector<RoutineMemory>& routines = data->memory.routines;
+        for (UINT32 id = 0; id < routines.size(); id++) {
+            const RoutineMemory& memory = routines[id];
+            if (memory.dataFootprint == NULL && memory.fetchStallCycles == 0 && memory.translationCycles == 0) {
+                continue;
+            }
+            RoutineProfile* routine = routineProfiles[id];
+            routine->dataAccessCycles += memory.dataAccessCycles;
+            routine->fetchStallCycles += memory.fetchStallCycles;
+            routine->translationCycles += memory.translationCycles;
+            if (memory.dataFootprint != NULL) {
+                if (routine->dataFootprint == NULL) {
+                    routine->dataFootprint = new FootprintBitmap(6);
+                }
+                routine->dataFootprint->Merge(*memory.dataFootprint);
+            }
+        }
+    }
+    PIN_ReleaseLock(&threadListLock);
+}
+
+// Clears everything reported for a window, so that each window starts from
+// cold caches and empty footprints. Summaries of blocks instrumented for an
+// earlier window stay in place with zero counts.
+VOID ResetStatistics() {
+    PIN_GetLock(&threadListLock, 0);
+    for (ThreadData* data : threadList) {
+        data->windowInstructions = 0;
+        data->bblCounts.Clear();
+        data->predicatedCounts.Clear();
+        data->loadStrides.clear();
+        ResetMemoryModel(data->memory);
+        DataflowState& dataflow = data->dataflow;
+        dataflow.instructions = 0;
+        dataflow.registerReads = 0;
+        dataflow.unproducedReads = 0;
+        std::fill(dataflow.dependencyHistogram, dataflow.dependencyHistogram + dependencyBins, 0);
+        std::fill(dataflow.lastWriter.begin(), dataflow.lastWriter.end(), 0);
+        for (IlpWindow& window : dataflow.windows) {
+            window.lastRetire = 0;
+            std::fill(window.retire.begin(), window.retire.end(), 0);
+            std::fill(window.ready.begin(), window.ready.end(), 0);
+        }
+    }
+    PIN_ReleaseLock(&threadListLock);
+
+    for (BblSummary* bbl : bblSummaries) {
+        bbl->count = 0;
+    }
+    for (InstructionSummary* ins : predicatedSummaries) {
+        ins->predicatedCount = 0;
+    }
+
+    std::fill(instructionMetrics, instructionMetrics + OTHER + 1, 0);
+    std::fill(instructionLengthResults, instructionLengthResults + 20, 0);
+    std::fill(memOperandCountResults, memOperandCountResults + 5, 0);
+    std::fill(memReadCountResults, memReadCountResults + 5, 0);
+    std::fill(memWriteCountResults, memWriteCountResults + 5, 0);
+    std::fill(operandCountResults, operandCountResults + 10, 0);
+    std::fill(regReadCountResults, regReadCountResults + 10, 0);
+    std::fill(regWriteCountResults, regWriteCountResults + 10, 0);
+    maxImmediate = INT_MIN;
+    minImmediate = INT_MAX;
+    maxDisplacement = INT_MIN;
+    minDisplacement = INT_MAX;
+
+    for (UINT32 i = 0; i < footprintGranularities; i++) {
+        delete instructionFootprint[i];
+        instructionFootprint[i] = new FootprintBitmap(footprintShifts[i]);
+    }
+    CreateLlc();
+
+    for (LoadProfile* load : loadProfiles) {
+        load->stride = 0;
+        load->executions = 0;
+        load->strideHits = 0;
+        load->l1dMisses = 0;
+    }
+    for (RoutineProfile* routine : routineProfiles) {
+        routine->instructions = 0;
+        std::fill(routine->metrics, routine->metrics + OTHER + 1, 0);
+        routine->memoryOperations = 0;
+        routine->dataAccessCycles = 0;
+        routine->fetchStallCycles = 0;
+        routine->translationCycles = 0;
+        delete routine->dataFootprint;
+        delete routine->codeFootprint;
+        routine->dataFootprint = NULL;
+        routine->codeFootprint = NULL;
     }
 }
 
@@ -142,7 +991,10 @@ INT32 Usage() {
     return -1;
 }
 
-VOID InstrumentInstruction(INS ins) {
+// Static analysis of an instruction, done the first time its block is
+// instrumented. Load profiles, dataflow descriptors and predicate counters
+// are allocated here once and kept with the summary.
+VOID SummarizeInstruction(INS ins, InstructionSummary* summary) {
     InstructionCategory instructionCategory;
     UINT64 loadSize = 0;
     UINT64 storeSize = 0;
@@ -153,6 +1005,7 @@ VOID InstrumentInstruction(INS ins) {
     INT32 minImm = INT_MAX;
     INT32 maxImm = INT_MIN;
     UINT32 memOpCount = INS_MemoryOperandCount(ins);
+    summary->firstLoadId = NO_LOAD_PROFILE;
 
     // Type A categories
     INT32 category = INS_Category(ins);
@@ -207,8 +1060,18 @@ VOID InstrumentInstruction(INS ins) {
         minDisp = (displacement < minDisp) ? displacement : minDisp;
         maxDisp = (displacement > maxDisp) ? displacement : maxDisp;
 
-        INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR) CheckFastForward, IARG_END);
-        INS_InsertThenPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR) MemoryBlockAnalysis, IARG_MEMORYOP_EA, memOp, IARG_MEMORYOP_SIZE, memOp, IARG_END);
+        if (INS_MemoryOperandIsRead(ins, memOp)) {
+            REG base = INS_OperandMemoryBaseReg(ins, INS_MemoryOperandIndexToOperandIndex(ins, memOp));
+            LoadProfile* load = new LoadProfile();
+            load->address = INS_Address(ins);
+            load->baseIsDestination = REG_valid(base) && INS_RegWContain(ins, base);
+
+            // An instruction's read operands get consecutive ids
+            if (memReadCount == 1) {
+                summary->firstLoadId = loadProfiles.size();
+            }
+            loadProfiles.push_back(load);
+        }
     }
 
     for (UINT32 i = 0; i < INS_OperandCount(ins); i++) {
@@ -219,67 +1082,767 @@ VOID InstrumentInstruction(INS ins) {
         }
     }
 
-    INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR) CheckFastForward, IARG_END);
-    INS_InsertThenPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR) PredicatedInstructionAnalysis,
-        IARG_UINT64, (UINT64) instructionCategory,
-        IARG_UINT64, (UINT64) loadSize,
-        IARG_UINT64, (UINT64) storeSize,
-        IARG_UINT64, (UINT64) memReadCount,
-        IARG_UINT64, (UINT64) memWriteCount,
-        IARG_ADDRINT, (ADDRINT) minDisp,
-        IARG_ADDRINT, (ADDRINT) maxDisp,
-        IARG_UINT64, (UINT64) (INS_IsMemoryRead(ins) || INS_IsMemoryWrite(ins)),
-        IARG_END
-    );
+    summary->predicatedCount = 0;
+    summary->predicatedId = 0;
+    summary->dataflow = NULL;
+    summary->address = INS_Address(ins);
+    summary->category = instructionCategory;
+    summary->isPredicated = INS_IsPredicated(ins);
+    summary->length = INS_Size(ins);
+    summary->operandCount = INS_OperandCount(ins);
+    summary->regReadCount = INS_MaxNumRRegs(ins);
+    summary->regWriteCount = INS_MaxNumWRegs(ins);
+    summary->loadSize = loadSize;
+    summary->storeSize = storeSize;
+    summary->memReadCount = memReadCount;
+    summary->memWriteCount = memWriteCount;
+    summary->isMemOp = (INS_IsMemoryRead(ins) || INS_IsMemoryWrite(ins));
+    summary->minImm = minImm;
+    summary->maxImm = maxImm;
+    summary->minDisp = minDisp;
+    summary->maxDisp = maxDisp;
+
+    if (KnobDataflow) {
+        DataflowInfo* dataflow = new DataflowInfo();
+        summary->dataflow = dataflow;
+        for (UINT32 i = 0; i < INS_MaxNumRRegs(ins) && dataflow->numReads < MAX_DATAFLOW_REGS; i++) {
+            REG reg = REG_FullRegName(INS_RegR(ins, i));
+            if (REG_valid(reg) && reg != REG_INST_PTR) {
+                dataflow->reads[dataflow->numReads++] = reg;
+            }
+        }
+        for (UINT32 i = 0; i < INS_MaxNumWRegs(ins) && dataflow->numWrites < MAX_DATAFLOW_REGS; i++) {
+            REG reg = REG_FullRegName(INS_RegW(ins, i));
+            if (REG_valid(reg) && reg != REG_INST_PTR) {
+                dataflow->writes[dataflow->numWrites++] = reg;
+            }
+        }
+    }
+
+    if (summary->isPredicated) {
+        summary->predicatedId = predicatedSummaries.size();
+        predicatedSummaries.push_back(summary);
+    }
+}
+
+// Inserts the analysis calls of an instruction; runs every time its block
+// is instrumented
+VOID InstrumentInstruction(INS ins, const InstructionSummary* summary, UINT32 routineId) {
+    // Effective addresses and sizes are the only per-operand dynamic data;
+    // the size is taken at run time because gathers, scatters and the
+    // XSAVE family touch a variable number of bytes
+    UINT32 loadId = summary->firstLoadId;
+    for (UINT32 memOp = 0; memOp < INS_MemoryOperandCount(ins); memOp++) {
+        BOOL read = INS_MemoryOperandIsRead(ins, memOp);
+        UINT32 flags = (read ? MEMORY_READ : 0) | (INS_MemoryOperandIsWritten(ins, memOp) ? MEMORY_WRITE : 0);
+        INS_InsertFillBufferPredicated(ins, IPOINT_BEFORE, memoryBuffer,
+            IARG_MEMORYOP_EA, memOp, offsetof(MemoryRecord, address),
+            IARG_MEMORYOP_SIZE, memOp, offsetof(MemoryRecord, size),
+            IARG_UINT32, flags, offsetof(MemoryRecord, flags),
+            IARG_UINT32, read ? loadId++ : NO_LOAD_PROFILE, offsetof(MemoryRecord, loadId),
+            IARG_UINT32, routineId, offsetof(MemoryRecord, routineId),
+            IARG_UINT32, windowSchedule.Index(), offsetof(MemoryRecord, window),
+            IARG_END
+        );
+    }
+
+    if (summary->dataflow != NULL) {
+        INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR) Dataflow, IARG_THREAD_ID, IARG_PTR, summary->dataflow, IARG_END);
+    }
 
-    INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR) CheckFastForward, IARG_END);
-    INS_InsertThenCall(ins, IPOINT_BEFORE, (AFUNPTR) InstructionAnalysis,
-        IARG_UINT64, (UINT64) INS_Size(ins),
-        IARG_ADDRINT, (ADDRINT) INS_Address(ins),
-        IARG_UINT64, (UINT64) INS_OperandCount(ins),
-        IARG_UINT64, (UINT64) INS_MaxNumRRegs(ins),
-        IARG_UINT64, (UINT64) INS_MaxNumWRegs(ins),
-        IARG_ADDRINT, (INT32) minImm,
-        IARG_ADDRINT, (INT32) maxImm,
-        IARG_END
-    );
+    // The predicate outcome is the only per-instruction dynamic data
+    if (summary->isPredicated) {
+        INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR) CountPredicated, IARG_THREAD_ID, IARG_UINT32, summary->predicatedId, IARG_END);
+    }
+}
+
+// The window is over. Every window but the last is reported here and the
+// tool goes back to fast-forwarding; the last one is reported by Fini (or
+// DetachFini). Either way the records still sitting in the threads' memory
+// buffers belong to this window, so they are processed first.
+VOID EndWindow(THREADID tid, CONTEXT* ctxt) {
+    if (!PIN_StopApplicationThreads(tid, PIN_INFINITE_TIMEOUT)) {
+        return;
+    }
+    BOOL ended = analysisPhase && !windowDone;
+    if (ended) {
+        DrainMemoryBuffers(tid, ctxt);
+    }
+    BOOL more = ended && windowSchedule.Next();
+    PIN_GetLock(&reportLock, tid + 1);
+    if (more) {
+        ReportWindow(windowSchedule.Index() - 1);
+        windowStart = windowSchedule.Start();
+        windowEnd = windowSchedule.End();
+        analysisPhase = false;
+    } else if (ended) {
+        windowDone = true;
+    }
+    PIN_ReleaseLock(&reportLock);
+    PIN_ResumeApplicationThreads(tid);
+    if (!ended) {
+        return;
+    }
+    if (more) {
+        PIN_RemoveInstrumentation();
+    } else if (KnobDetach) {
+        // Results are printed from the detach callback; the application
+        // keeps running natively
+        PIN_Detach();
+    } else {
+        PIN_ExitApplication(0);
+    }
 }
 
-VOID Terminate() {
-    Fini(0, 0);
-    exit(0);
+VOID PrepareForFini(VOID* v);
+
+VOID DetachFini(VOID* v) {
+    PrepareForFini(v);
+    Fini(0, v);
+}
+
+RoutineProfile* NewRoutineProfile(const string& name, const string& image) {
+    RoutineProfile* routine = new RoutineProfile();
+    routine->name = name;
+    routine->image = image;
+    return routine;
+}
+
+// Instrumentation-time lookup of the routine containing `address`
+UINT32 FindRoutine(ADDRINT address) {
+    PIN_LockClient();
+    RTN rtn = RTN_FindByAddress(address);
+    if (!RTN_Valid(rtn)) {
+        PIN_UnlockClient();
+        return 0;
+    }
+    std::pair<std::unordered_map<ADDRINT, UINT32>::iterator, bool> result = routineIds.insert(std::make_pair(RTN_Address(rtn), 0));
+    if (result.second) {
+        result.first->second = routineProfiles.size();
+        routineProfiles.push_back(NewRoutineProfile(RTN_Name(rtn), IMG_Name(SEC_Img(RTN_Sec(rtn)))));
+    }
+    PIN_UnlockClient();
+    return result.first->second;
+}
+
+VOID ThreadStart(THREADID tid, CONTEXT* ctxt, INT32 flags, VOID* v) {
+    ThreadData* data = new ThreadData;
+    for (UINT32 size : ilpWindowSizes) {
+        IlpWindow window;
+        window.size = size;
+        window.lastRetire = 0;
+        window.retire.assign(size, 0);
+        window.ready.assign(REG_LAST + 1, 0);
+        data->dataflow.windows.push_back(window);
+    }
+    data->bufferStart = PIN_GetBufferPointer(ctxt, memoryBuffer);
+    PIN_InitLock(&data->memory.lock);
+    ResetMemoryModel(data->memory);
+    PIN_SetThreadData(threadDataKey, data, tid);
+
+    PIN_GetLock(&threadListLock, tid + 1);
+    data->bblCounts.Reserve(bblSummaries.size());
+    data->predicatedCounts.Reserve(predicatedSummaries.size());
+    threadList.push_back(data);
+    PIN_ReleaseLock(&threadListLock);
+}
+
+// Makes room in every thread's counters for the ids handed out so far
+VOID ReserveThreadCounters() {
+    PIN_GetLock(&threadListLock, PIN_ThreadId() + 1);
+    for (ThreadData* data : threadList) {
+        data->bblCounts.Reserve(bblSummaries.size());
+        data->predicatedCounts.Reserve(predicatedSummaries.size());
+    }
+    PIN_ReleaseLock(&threadListLock);
 }
 
 /* ===================================================================== */
 // Analysis routines
 /* ===================================================================== */
-VOID Trace(TRACE trace, VOID* v) {
+VOID TraceBbv(TRACE trace) {
     for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
-        for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
-            InstrumentInstruction(ins);
+        std::pair<std::unordered_map<ADDRINT, UINT32>::iterator, bool> result = bbvIds.insert(std::make_pair(BBL_Address(bbl), 0));
+        if (result.second) {
+            result.first->second = bbvIds.size();
         }
-        BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR) CountInstruction, IARG_UINT32, BBL_NumIns(bbl), IARG_END);
+        BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR) CountBbv, IARG_THREAD_ID, IARG_UINT32, result.first->second, IARG_UINT32, BBL_NumIns(bbl), IARG_END);
+        BBL_InsertThenCall(bbl, IPOINT_BEFORE, (AFUNPTR) EndBbvInterval, IARG_END);
+    }
+}
+
+BOOL SameShape(const BblSummary* summary, BBL bbl) {
+    if (summary->numIns != BBL_NumIns(bbl) || summary->size != BBL_Size(bbl)) {
+        return false;
+    }
+    UINT32 i = 0;
+    for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins), i++) {
+        if (summary->instructions[i].length != INS_Size(ins)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The block's summary, created on first sight. Code replaced at a known
+// address (after an unload) gets a summary of its own, and finds it again
+// if the two versions keep alternating.
+BblSummary* GetBblSummary(BBL bbl) {
+    auto range = bblSummaryCache.equal_range(BBL_Address(bbl));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (SameShape(it->second, bbl)) {
+            return it->second;
+        }
+    }
+    BblSummary* summary = new BblSummary;
+    summary->count = 0;
+    summary->id = bblSummaries.size();
+    summary->routineId = FindRoutine(BBL_Address(bbl));
+    summary->numIns = BBL_NumIns(bbl);
+    summary->size = BBL_Size(bbl);
+    summary->instructions = new InstructionSummary[summary->numIns];
+    UINT32 i = 0;
+    for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+        SummarizeInstruction(ins, &summary->instructions[i++]);
+    }
+    bblSummaries.push_back(summary);
+    bblSummaryCache.emplace(BBL_Address(bbl), summary);
+    return summary;
+}
+
+VOID Trace(TRACE trace, VOID* v) {
+    if (KnobBbv) {
+        TraceBbv(trace);
+        return;
+    }
+    if (windowDone) {
+        return;
+    }
+    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+        if (analysisPhase) {
+            BblSummary* summary = GetBblSummary(bbl);
+
+            // Instruction fetch: the block's bytes, ahead of its data accesses
+            INS_InsertFillBuffer(BBL_InsHead(bbl), IPOINT_BEFORE, memoryBuffer,
+                IARG_ADDRINT, BBL_Address(bbl), offsetof(MemoryRecord, address),
+                IARG_UINT32, (UINT32) BBL_Size(bbl), offsetof(MemoryRecord, size),
+                IARG_UINT32, (UINT32) MEMORY_FETCH, offsetof(MemoryRecord, flags),
+                IARG_UINT32, NO_LOAD_PROFILE, offsetof(MemoryRecord, loadId),
+                IARG_UINT32, summary->routineId, offsetof(MemoryRecord, routineId),
+                IARG_UINT32, windowSchedule.Index(), offsetof(MemoryRecord, window),
+                IARG_END);
 
-        BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR) CheckTerminate, IARG_END);
-        BBL_InsertThenCall(bbl, IPOINT_BEFORE, (AFUNPTR) Terminate, IARG_END);
+            if (traceRecorder.Enabled()) {
+                traceRecorder.InstrumentBbl(bbl, NULL);
+            }
+
+            UINT32 i = 0;
+            for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+                InstrumentInstruction(ins, &summary->instructions[i++], summary->routineId);
+            }
+            BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR) CountBblAndCheckTerminate, IARG_THREAD_ID, IARG_UINT32, summary->id, IARG_UINT32, summary->numIns, IARG_END);
+            BBL_InsertThenCall(bbl, IPOINT_BEFORE, (AFUNPTR) EndWindow, IARG_THREAD_ID, IARG_CONTEXT, IARG_END);
+        } else {
+            // Fast-forward phase: only the block counter and this check run
+            BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR) CountAndCheckFastForward, IARG_THREAD_ID, IARG_UINT32, BBL_NumIns(bbl), IARG_END);
+            BBL_InsertThenCall(bbl, IPOINT_BEFORE, (AFUNPTR) EnterAnalysisPhase, IARG_THREAD_ID, IARG_END);
+        }
+    }
+    if (analysisPhase) {
+        ReserveThreadCounters();
     }
 }
 
+inline double Mpki(UINT64 events, UINT64 instructions) { return instructions ? 1000.0 * events / instructions : 0.0; }
+
+// One cycle per instruction plus the cycles spent in the cache hierarchy and
+// address translation
 double calculateCpi() {
     UINT64 total = 0;
-    double cpi = 0;
     for (UINT64 i = 0; i < OTHER + 1; i++) {
         total += instructionMetrics[i];
-        cpi += 1.0 * instructionMetrics[i];
     }
 
-    cpi += 69.0 * instructionMetrics[LOAD];
-    cpi += 69.0 * instructionMetrics[STORE];
+    double cpi = 1.0 * total;
+    cpi += 1.0 * dataAccessCycles;
+    cpi += 1.0 * fetchStallCycles;
+    cpi += 1.0 * translationCycles;
 
     cpi /= (1.0) * total;
     return cpi;
 }
 
+struct DataflowTotals {
+    UINT64 instructions = 0;
+    UINT64 registerReads = 0;
+    UINT64 unproducedReads = 0;
+    UINT64 dependencyHistogram[dependencyBins] = {0};
+    vector<UINT64> cycles = vector<UINT64>(ilpWindowSizes.size(), 0);
+};
+
+DataflowTotals SumDataflow() {
+    DataflowTotals totals;
+    PIN_GetLock(&threadListLock, 0);
+    for (ThreadData* data : threadList) {
+        const DataflowState& state = data->dataflow;
+        totals.instructions += state.instructions;
+        totals.registerReads += state.registerReads;
+        totals.unproducedReads += state.unproducedReads;
+        for (UINT32 bin = 0; bin < dependencyBins; bin++) {
+            totals.dependencyHistogram[bin] += state.dependencyHistogram[bin];
+        }
+        // Threads run side by side on separate cores, so the run takes as
+        // long as the longest thread's schedule
+        for (UINT32 w = 0; w < ilpWindowSizes.size(); w++) {
+            totals.cycles[w] = std::max(totals.cycles[w], state.windows[w].lastRetire);
+        }
+    }
+    PIN_ReleaseLock(&threadListLock);
+    return totals;
+}
+
+VOID PrintDataflow() {
+    DataflowTotals totals = SumDataflow();
+
+    *out << "===============================================" << endl;
+    *out << "Register Dependency Distance Results (" << totals.registerReads << " register reads, "
+         << totals.unproducedReads << " without a producer in the window):" << endl;
+    for (UINT32 bin = 1; bin < dependencyBins; bin++) {
+        if (totals.dependencyHistogram[bin]) {
+            *out << "[" << (1ULL << (bin - 1)) << ", " << (1ULL << bin) << ") : " << totals.dependencyHistogram[bin] << endl;
+        }
+    }
+    *out << "ILP Limit Results:" << endl;
+    for (UINT32 w = 0; w < ilpWindowSizes.size(); w++) {
+        *out << "Window " << ilpWindowSizes[w] << " : " << totals.cycles[w] << " cycles, ILP "
+             << (totals.cycles[w] ? 1.0 * totals.instructions / totals.cycles[w] : 0.0) << endl;
+    }
+}
+
+const char* categoryNames[] = {
+    "Loads", "Stores", "Nops", "Direct Calls", "Indirect Calls", "Returns", "Unconditional Branches",
+    "Conditional Branches", "Logical", "Rotate and Shift", "Flag", "Vector", "Conditional Moves",
+    "MMX and SSE", "System Calls", "Floating Point", "Others"
+};
+
+BOOL MoreInstructions(const RoutineProfile* a, const RoutineProfile* b) { return a->instructions > b->instructions; }
+
+// Same model as calculateCpi, restricted to one routine or image
+double RoutineCpi(const RoutineProfile* routine) {
+    UINT64 total = 0;
+    for (UINT64 i = 0; i < OTHER + 1; i++) {
+        total += routine->metrics[i];
+    }
+    return total ? (1.0 * total + routine->dataAccessCycles + routine->fetchStallCycles + routine->translationCycles) / total
+                 : 0.0;
+}
+
+// Moves the hottest profiles to the front and returns how many to report
+UINT32 SortHotspots(vector<RoutineProfile*>& profiles) {
+    UINT32 top = std::min<size_t>(KnobTopRoutines.Value(), profiles.size());
+    std::partial_sort(profiles.begin(), profiles.begin() + top, profiles.end(), MoreInstructions);
+    return top;
+}
+
+VOID PrintHotspots(vector<RoutineProfile*>& profiles, const char* title, BOOL printImage) {
+    UINT32 top = SortHotspots(profiles);
+
+    *out << "Top " << top << " " << title << " by instructions:" << endl;
+    for (UINT32 i = 0; i < top; i++) {
+        const RoutineProfile* routine = profiles[i];
+        if (routine->instructions == 0) {
+            break;
+        }
+        UINT64 total = 0;
+        for (UINT64 c = 0; c < OTHER + 1; c++) {
+            total += routine->metrics[c];
+        }
+        *out << routine->name;
+        if (printImage) {
+            *out << " (" << routine->image << ")";
+        }
+        *out << " : " << routine->instructions << " instructions, " << routine->memoryOperations << " memory operations, CPI "
+             << RoutineCpi(routine) << ", footprint code " << (routine->codeFootprint ? routine->codeFootprint->Bytes() : 0)
+             << " B data " << (routine->dataFootprint ? routine->dataFootprint->Bytes() : 0) << " B" << endl;
+        *out << "   ";
+        for (UINT64 c = 0; c < OTHER + 1; c++) {
+            if (routine->metrics[c]) {
+                *out << " " << categoryNames[c] << " " << 100.0 * routine->metrics[c] / total << "%";
+            }
+        }
+        *out << endl;
+    }
+}
+
+// Images are the sum of their routines; footprints are not carried over.
+// The profiles are built for one report and freed with DeleteProfiles.
+vector<RoutineProfile*> ImageProfiles() {
+    vector<RoutineProfile*> images;
+    std::unordered_map<string, RoutineProfile*> byImage;
+    for (const RoutineProfile* routine : routineProfiles) {
+        RoutineProfile*& image = byImage[routine->image];
+        if (image == NULL) {
+            image = NewRoutineProfile(routine->image, routine->image);
+            images.push_back(image);
+        }
+        image->instructions += routine->instructions;
+        for (UINT64 c = 0; c < OTHER + 1; c++) {
+            image->metrics[c] += routine->metrics[c];
+        }
+        image->memoryOperations += routine->memoryOperations;
+        image->dataAccessCycles += routine->dataAccessCycles;
+        image->fetchStallCycles += routine->fetchStallCycles;
+        image->translationCycles += routine->translationCycles;
+    }
+    return images;
+}
+
+VOID DeleteProfiles(vector<RoutineProfile*>& profiles) {
+    for (RoutineProfile* profile : profiles) {
+        delete profile->dataFootprint;
+        delete profile->codeFootprint;
+        delete profile;
+    }
+    profiles.clear();
+}
+
+VOID PrintRoutineProfiles() {
+    vector<RoutineProfile*> images = ImageProfiles();
+    vector<RoutineProfile*> routines(routineProfiles);
+
+    *out << "===============================================" << endl;
+    *out << "Hotspot Results:" << endl;
+    PrintHotspots(routines, "routines", true);
+    PrintHotspots(images, "images", false);
+    DeleteProfiles(images);
+}
+
+BOOL MoreL1DMisses(const LoadProfile* a, const LoadProfile* b) { return a->l1dMisses > b->l1dMisses; }
+
+const char* loadClassNames[] = {"constant-stride", "pointer-chasing", "irregular"};
+
+// Each thread's counts are summed into the profiles first. A load replaced
+// by new code at the same address shows up more than once; merge the
+// profiles by address. Each load's stride is the one with the most
+// executions behind it, summed over the threads that followed it.
+vector<LoadProfile*> MergeLoadProfiles() {
+    for (LoadProfile* load : loadProfiles) {
+        load->executions = 0;
+        load->strideHits = 0;
+        load->l1dMisses = 0;
+    }
+    std::unordered_map<ADDRINT, std::unordered_map<INT64, UINT64> > strideWeights;
+    PIN_GetLock(&threadListLock, 0);
+    for (const ThreadData* data : threadList) {
+        for (UINT32 id = 0; id < data->loadStrides.size(); id++) {
+            const LoadStride& state = data->loadStrides[id];
+            if (state.executions > 0) {
+                LoadProfile* load = loadProfiles[id];
+                load->executions += state.executions;
+                load->strideHits += state.strideHits;
+                load->l1dMisses += state.l1dMisses;
+                strideWeights[load->address][state.stride] += state.executions;
+            }
+        }
+    }
+    PIN_ReleaseLock(&threadListLock);
+
+    vector<LoadProfile*> loads;
+    std::unordered_map<ADDRINT, LoadProfile*> byAddress;
+    for (LoadProfile* load : loadProfiles) {
+        if (load->executions == 0) {
+            continue;
+        }
+        LoadProfile*& merged = byAddress[load->address];
+        if (merged == NULL) {
+            merged = load;
+            loads.push_back(load);
+        } else {
+            merged->executions += load->executions;
+            merged->strideHits += load->strideHits;
+            merged->l1dMisses += load->l1dMisses;
+        }
+    }
+    for (LoadProfile* load : loads) {
+        UINT64 heaviest = 0;
+        load->stride = 0;
+        for (const std::pair<const INT64, UINT64>& weight : strideWeights[load->address]) {
+            if (weight.second > heaviest) {
+                heaviest = weight.second;
+                load->stride = weight.first;
+            }
+        }
+    }
+    return loads;
+}
+
+// Moves the loads with the most L1D misses to the front and returns how many to report
+UINT32 SortLoads(vector<LoadProfile*>& loads) {
+    UINT32 top = std::min<size_t>(KnobTopLoads.Value(), loads.size());
+    std::partial_sort(loads.begin(), loads.begin() + top, loads.end(), MoreL1DMisses);
+    return top;
+}
+
+VOID PrintLoadProfiles() {
+    UINT64 loadsByClass[3] = {0};
+    UINT64 missesByClass[3] = {0};
+    vector<LoadProfile*> loads = MergeLoadProfiles();
+    for (LoadProfile* load : loads) {
+        loadsByClass[ClassifyLoad(load)] += load->executions;
+        missesByClass[ClassifyLoad(load)] += load->l1dMisses;
+    }
+
+    UINT32 top = SortLoads(loads);
+
+    *out << "===============================================" << endl;
+    *out << "Load Stride Results:" << endl;
+    for (UINT32 c = 0; c < 3; c++) {
+        *out << loadClassNames[c] << " : " << loadsByClass[c] << " loads, " << missesByClass[c] << " L1D misses" << endl;
+    }
+    *out << "Top " << top << " static loads by L1D misses:" << endl;
+    for (UINT32 i = 0; i < top; i++) {
+        const LoadProfile* load = loads[i];
+        *out << std::hex << "0x" << load->address << std::dec << " : " << load->executions << " executions, "
+             << load->l1dMisses << " L1D misses, stride " << load->stride << " ("
+             << 100.0 * load->strideHits / load->executions << "% hits), " << loadClassNames[ClassifyLoad(load)] << endl;
+    }
+}
+
+VOID PrintCacheStats(const char* name, const Cache* cache) {
+    *out << name << " : " << cache->Accesses() << " accesses, " << cache->Misses() << " misses ("
+         << (cache->Accesses() ? 100.0 * cache->Misses() / cache->Accesses() : 0.0) << "% miss rate)" << endl;
+}
+
+VOID AddCacheMetrics(MetricReport& report, const char* name, const Cache* cache) {
+    string prefix = MetricName(name);
+    report.Add("cache", prefix + "_accesses", cache->Accesses());
+    report.Add("cache", prefix + "_misses", cache->Misses());
+}
+
+VOID AddTlbMetrics(MetricReport& report, UINT32 pageSize, UINT64 instructionCount) {
+    const TlbHierarchy* tlb = tlbs[pageSize];
+    string group = "tlb_" + MetricName(pageSizeNames[pageSize]);
+    const Cache* levels[] = {tlb->Itlb(), tlb->Dtlb(), tlb->Stlb()};
+    const char* names[] = {"itlb", "dtlb", "stlb"};
+    for (UINT32 l = 0; l < 3; l++) {
+        report.Add(group, string(names[l]) + "_accesses", levels[l]->Accesses());
+        report.Add(group, string(names[l]) + "_misses", levels[l]->Misses());
+        report.Add(group, string(names[l]) + "_mpki", Mpki(levels[l]->Misses(), instructionCount));
+    }
+    report.Add(group, "walks", tlb->Walks());
+    report.Add(group, "cycles", tlb->Cycles());
+}
+
+VOID AddHistogramMetrics(MetricReport& report, const string& group, const UINT64* histogram, UINT32 size) {
+    for (UINT32 i = 0; i < size; i++) {
+        report.Add(group, std::to_string(i), histogram[i]);
+    }
+}
+
+VOID AddHotspotMetrics(MetricReport& report, vector<RoutineProfile*>& profiles, const string& kind) {
+    UINT32 top = SortHotspots(profiles);
+    for (UINT32 i = 0; i < top && profiles[i]->instructions; i++) {
+        const RoutineProfile* routine = profiles[i];
+        string group = kind + "_" + std::to_string(i);
+        report.Add(group, "name", routine->name);
+        report.Add(group, "image", routine->image);
+        report.Add(group, "instructions", routine->instructions);
+        report.Add(group, "memory_operations", routine->memoryOperations);
+        report.Add(group, "cpi", RoutineCpi(routine));
+        report.Add(group, "code_footprint_bytes", routine->codeFootprint ? routine->codeFootprint->Bytes() : 0);
+        report.Add(group, "data_footprint_bytes", routine->dataFootprint ? routine->dataFootprint->Bytes() : 0);
+        for (UINT64 c = 0; c < OTHER + 1; c++) {
+            report.Add(group, MetricName(categoryNames[c]), routine->metrics[c]);
+        }
+    }
+}
+
+// The same results as the text report, for -format json and csv. Histogram
+// bins are named by their lower bound.
+VOID WriteWindowMetrics(UINT32 window, UINT64 instructionCount) {
+    MetricReport report("window", window);
+    report.Add("window", "start", windowStart);
+    report.Add("window", "end", windowEnd);
+    report.Add("window", "instructions", instructionCount);
+
+    UINT64 totalInstructions = 0;
+    for (UINT64 c = 0; c < OTHER + 1; c++) {
+        report.Add("instruction_types", MetricName(categoryNames[c]), instructionMetrics[c]);
+        totalInstructions += instructionMetrics[c];
+    }
+    report.Add("instruction_types", "total", totalInstructions);
+    report.Add("instruction_types", "cpi", calculateCpi());
+
+    AddHistogramMetrics(report, "instruction_size", instructionLengthResults, 20);
+    AddHistogramMetrics(report, "memory_operands", memOperandCountResults, 5);
+    AddHistogramMetrics(report, "memory_read_operands", memReadCountResults, 5);
+    AddHistogramMetrics(report, "memory_write_operands", memWriteCountResults, 5);
+    AddHistogramMetrics(report, "operands", operandCountResults, 10);
+    AddHistogramMetrics(report, "register_read_operands", regReadCountResults, 10);
+    AddHistogramMetrics(report, "register_write_operands", regWriteCountResults, 10);
+
+    UINT64 memInstrCount = 0;
+    for (int i = 1; i < 5; ++i) {
+        memInstrCount += memOperandCountResults[i];
+    }
+    report.Add("memory", "max_bytes", maxMemBytes);
+    report.Add("memory", "average_bytes", 1.0 * totalMemBytes / memInstrCount);
+    report.Add("memory", "max_immediate", maxImmediate);
+    report.Add("memory", "min_immediate", minImmediate);
+    report.Add("memory", "max_displacement", (INT64) maxDisplacement);
+    report.Add("memory", "min_displacement", (INT64) minDisplacement);
+
+    for (UINT32 i = 0; i < footprintGranularities; i++) {
+        string granularity = std::to_string(1 << footprintShifts[i]);
+        report.Add("footprint", "instruction_blocks_" + granularity, instructionFootprint[i]->Blocks());
+        report.Add("footprint", "memory_blocks_" + granularity, memoryFootprint[i]->Blocks());
+    }
+
+    AddCacheMetrics(report, "L1I", l1iCache);
+    AddCacheMetrics(report, "L1D", l1dCache);
+    AddCacheMetrics(report, "L2", l2Cache);
+    AddCacheMetrics(report, "LLC", llcCache);
+    report.Add("cache", "data_access_cycles", dataAccessCycles);
+    report.Add("cache", "fetch_stall_cycles", fetchStallCycles);
+
+    for (UINT32 i = 0; i < pageSizes; i++) {
+        AddTlbMetrics(report, i, instructionCount);
+    }
+    report.Add("translation", "cycles", translationCycles);
+    report.Add("translation", "cpi_page_size", MetricName(pageSizeNames[cpiPageSize]));
+    report.Add("crossings", "cache_line", lineCrossings);
+    for (UINT32 i = 0; i < pageSizes; i++) {
+        report.Add("crossings", "page_" + MetricName(pageSizeNames[i]), pageCrossings[i]);
+    }
+
+    report.Add("reuse_distance", "accesses", blockReuse->Accesses());
+    report.Add("reuse_distance", "cold", blockReuse->ColdMisses());
+    UINT32 lastBin = 0;
+    for (UINT32 bin = 0; bin < ReuseDistance::BINS; bin++) {
+        lastBin = blockReuse->Histogram(bin) ? bin : lastBin;
+    }
+    for (UINT32 bin = 0; bin <= lastBin; bin++) {
+        report.Add("reuse_distance", std::to_string(bin ? 1ULL << (bin - 1) : 0), blockReuse->Histogram(bin));
+    }
+    for (UINT32 sizeLog = 0; sizeLog <= lastBin; sizeLog++) {
+        report.Add("miss_ratio_curve", std::to_string((1ULL << sizeLog) << reuseBlockShift), blockReuse->Misses(sizeLog));
+    }
+
+    vector<LoadProfile*> loads = MergeLoadProfiles();
+    UINT64 loadsByClass[3] = {0};
+    UINT64 missesByClass[3] = {0};
+    for (const LoadProfile* load : loads) {
+        loadsByClass[ClassifyLoad(load)] += load->executions;
+        missesByClass[ClassifyLoad(load)] += load->l1dMisses;
+    }
+    for (UINT32 c = 0; c < 3; c++) {
+        report.Add("load_classes", MetricName(loadClassNames[c]) + "_loads", loadsByClass[c]);
+        report.Add("load_classes", MetricName(loadClassNames[c]) + "_l1d_misses", missesByClass[c]);
+    }
+    UINT32 top = SortLoads(loads);
+    for (UINT32 i = 0; i < top; i++) {
+        const LoadProfile* load = loads[i];
+        string group = "load_" + std::to_string(i);
+        std::ostringstream address;
+        address << "0x" << std::hex << load->address;
+        report.Add(group, "address", address.str());
+        report.Add(group, "executions", load->executions);
+        report.Add(group, "l1d_misses", load->l1dMisses);
+        report.Add(group, "stride", load->stride);
+        report.Add(group, "stride_hit_rate", 1.0 * load->strideHits / load->executions);
+        report.Add(group, "class", string(loadClassNames[ClassifyLoad(load)]));
+    }
+
+    vector<RoutineProfile*> images = ImageProfiles();
+    vector<RoutineProfile*> routines(routineProfiles);
+    AddHotspotMetrics(report, routines, "routine");
+    AddHotspotMetrics(report, images, "image");
+    DeleteProfiles(images);
+
+    if (KnobDataflow) {
+        DataflowTotals totals = SumDataflow();
+        report.Add("dependency_distance", "register_reads", totals.registerReads);
+        report.Add("dependency_distance", "unproduced_reads", totals.unproducedReads);
+        for (UINT32 bin = 1; bin < dependencyBins; bin++) {
+            report.Add("dependency_distance", std::to_string(1ULL << (bin - 1)), totals.dependencyHistogram[bin]);
+        }
+        for (UINT32 w = 0; w < ilpWindowSizes.size(); w++) {
+            string size = std::to_string(ilpWindowSizes[w]);
+            report.Add("ilp", "cycles_" + size, totals.cycles[w]);
+            report.Add("ilp", "ilp_" + size, totals.cycles[w] ? 1.0 * totals.instructions / totals.cycles[w] : 0.0);
+        }
+    }
+
+    report.Write(*out, reportFormat);
+}
+
+// Instructions executed so far by all threads, for the snapshot thread
+UINT64 TotalInstructions() {
+    UINT64 instructions = 0;
+    PIN_GetLock(&threadListLock, 0);
+    for (const ThreadData* data : threadList) {
+        instructions += data->instructionCount;
+    }
+    PIN_ReleaseLock(&threadListLock);
+    return instructions;
+}
+
+// Runs on the snapshot thread. Only counters that are kept up to date while
+// the application runs are reported: the instruction mix is folded from the
+// block counts at the end of the window, so it is not part of a snapshot.
+VOID WriteSnapshot(UINT32 index, UINT64 instructions, UINT64 seconds) {
+    PIN_GetLock(&reportLock, PIN_ThreadId() + 1);
+    MetricReport report("snapshot", windowSchedule.Index());
+    report.Add("progress", "snapshot", index);
+    report.Add("progress", "seconds", seconds);
+    report.Add("progress", "instructions", instructions);
+    report.Add("progress", "in_window", (UINT32) (analysisPhase && !windowDone));
+    if (analysisPhase && !windowDone) {
+        UINT64 windowInstructions = 0;
+        PIN_GetLock(&threadListLock, 0);
+        for (const ThreadData* data : threadList) {
+            windowInstructions += data->windowInstructions;
+        }
+        PIN_ReleaseLock(&threadListLock);
+        report.Add("progress", "window_instructions", windowInstructions);
+
+        MergeMemoryModels();
+        AddCacheMetrics(report, "L1I", l1iCache);
+        AddCacheMetrics(report, "L1D", l1dCache);
+        AddCacheMetrics(report, "L2", l2Cache);
+        AddCacheMetrics(report, "LLC", llcCache);
+        report.Add("cache", "data_access_cycles", dataAccessCycles);
+        report.Add("cache", "fetch_stall_cycles", fetchStallCycles);
+        report.Add("cache", "translation_cycles", translationCycles);
+        report.Add("cache", "cpi",
+                   windowInstructions ? 1.0 * (windowInstructions + dataAccessCycles + fetchStallCycles + translationCycles) / windowInstructions : 0.0);
+        AddTlbMetrics(report, cpiPageSize, windowInstructions);
+        report.Add("footprint", "memory_blocks_" + std::to_string(1 << footprintShifts[0]), memoryFootprint[0]->Blocks());
+        report.Add("reuse_distance", "accesses", blockReuse->Accesses());
+    }
+    report.Write(*snapshotOut, reportFormat);
+    PIN_ReleaseLock(&reportLock);
+}
+
+VOID PrepareForFini(VOID* v) { snapshotThread.Stop(); }
+
+VOID PrintTlbStats(UINT64 instructionCount) {
+    *out << "===============================================" << endl;
+    *out << "TLB Results (" << pageSizeNames[cpiPageSize] << " pages in the CPI model):" << endl;
+    for (UINT32 i = 0; i < pageSizes; i++) {
+        const TlbHierarchy* tlb = tlbs[i];
+        *out << pageSizeNames[i] << " pages : ITLB " << tlb->Itlb()->Misses() << " misses (" << Mpki(tlb->Itlb()->Misses(), instructionCount)
+             << " MPKI), DTLB " << tlb->Dtlb()->Misses() << " misses (" << Mpki(tlb->Dtlb()->Misses(), instructionCount)
+             << " MPKI), STLB " << tlb->Stlb()->Misses() << " misses (" << Mpki(tlb->Stlb()->Misses(), instructionCount)
+             << " MPKI), " << tlb->Walks() << " page walks, " << tlb->Cycles() << " translation cycles" << endl;
+    }
+    *out << "Translation cycles : " << translationCycles << endl;
+    *out << "Accesses crossing a cache line : " << lineCrossings << " (" << (memoryAccesses ? 100.0 * lineCrossings / memoryAccesses : 0.0) << "%)" << endl;
+    for (UINT32 i = 0; i < pageSizes; i++) {
+        *out << "Accesses crossing a " << pageSizeNames[i] << " page : " << pageCrossings[i] << endl;
+    }
+}
+
 /*!
  * Print out analysis results.
  * This function is called when the application exits.
@@ -287,7 +1850,62 @@ double calculateCpi() {
  * @param[in]   v               value specified by the tool in the 
  *                              PIN_AddFiniFunction function call
  */
+VOID FiniBbv() {
+    if (bbvInstructions > 0) {
+        EndBbvInterval();
+    }
+    bbvOut->close();
+
+    string prefix = KnobBbvPrefix.Value();
+    vector<SimPointClustering::SimPoint> simPoints = simPointClustering.Cluster(KnobMaxK.Value());
+    std::ofstream simPointsOut((prefix + ".simpoints").c_str());
+    std::ofstream weightsOut((prefix + ".weights").c_str());
+    for (const SimPointClustering::SimPoint& simPoint : simPoints) {
+        simPointsOut << simPoint.interval << " " << simPoint.cluster << endl;
+        weightsOut << simPoint.weight << " " << simPoint.cluster << endl;
+    }
+
+    *out << "Collected " << simPointClustering.Intervals() << " intervals of " << bbvInterval << " instructions over "
+         << bbvIds.size() << " basic blocks into " << prefix << ".bb" << endl;
+    *out << "===============================================" << endl;
+    *out << "Simulation Points (interval : first instruction : weight):" << endl;
+    for (const SimPointClustering::SimPoint& simPoint : simPoints) {
+        *out << simPoint.interval << " : " << simPoint.interval * bbvInterval << " : " << simPoint.weight << endl;
+    }
+}
+
 VOID Fini(INT32 code, VOID* v) {
+    if (KnobBbv) {
+        FiniBbv();
+        return;
+    }
+
+    if (traceRecorder.Enabled()) {
+        traceRecorder.Close();
+    }
+
+    // Nothing to report if the run ended between two windows
+    if (analysisPhase || windowSchedule.Index() == 0) {
+        ReportWindow(windowSchedule.Index());
+    }
+}
+
+VOID ReportWindow(UINT32 window) {
+    UINT64 instructionCount = MergeThreadCounts();
+    MergeMemoryModels();
+    MergeRoutineMemory();
+    AccumulateBblSummaries();
+
+    if (reportFormat != REPORT_TEXT) {
+        WriteWindowMetrics(window, instructionCount);
+        return;
+    }
+
+    if (windowSchedule.Multiple()) {
+        *out << "===============================================" << endl;
+        *out << "Window " << window << " : instructions [" << windowStart << ", " << windowEnd << ")" << endl;
+    }
+
     UINT64 totalInstructions = 0;
     for (UINT64 i = 0; i < OTHER + 1; i++) {
         totalInstructions += instructionMetrics[i];
@@ -356,14 +1974,55 @@ VOID Fini(INT32 code, VOID* v) {
 
     double avgMemBytes = (totalMemBytes * 1.0) / memInstrCount;
 
-    *out << "Instruction Blocks Accesses : " << instructionBlocks.size() << endl;
-    *out << "Memory Blocks Accesses : " << memoryBlocks.size() << endl;
+    *out << "Instruction Blocks Accesses : " << instructionFootprint[0]->Blocks() << endl;
+    *out << "Memory Blocks Accesses : " << memoryFootprint[0]->Blocks() << endl;
+    for (UINT32 i = 0; i < footprintGranularities; i++) {
+        *out << "Footprint at " << (1 << footprintShifts[i]) << " B granularity : "
+             << "instruction " << instructionFootprint[i]->Blocks() << " blocks (" << instructionFootprint[i]->Bytes() << " bytes), "
+             << "memory " << memoryFootprint[i]->Blocks() << " blocks (" << memoryFootprint[i]->Bytes() << " bytes)" << endl;
+    }
     *out << "Maximum number of bytes touched by an instruction : " << maxMemBytes << endl;
     *out << "Average number of bytes touched by an instruction : " << avgMemBytes << endl;
     *out << "Maximum value of immediate : " << maxImmediate << endl;
     *out << "Minimum value of immediate : " << minImmediate << endl;
     *out << "Maximum value of displacement used in memory addressing : " << maxDisplacement << endl;
     *out << "Minimum value of displacement used in memory addressing : " << minDisplacement << endl;
+
+    *out << "===============================================" << endl;
+    *out << "Cache Results:" << endl;
+    PrintCacheStats("L1I", l1iCache);
+    PrintCacheStats("L1D", l1dCache);
+    PrintCacheStats("L2", l2Cache);
+    PrintCacheStats("LLC", llcCache);
+    *out << "Data access cycles : " << dataAccessCycles << " (" << (memoryAccesses ? 1.0 * dataAccessCycles / memoryAccesses : 0.0) << " per access)" << endl;
+    *out << "Instruction fetch stall cycles : " << fetchStallCycles << endl;
+
+    PrintTlbStats(instructionCount);
+
+    UINT32 lastBin = 0;
+    for (UINT32 bin = 0; bin < ReuseDistance::BINS; bin++) {
+        lastBin = blockReuse->Histogram(bin) ? bin : lastBin;
+    }
+    *out << "===============================================" << endl;
+    *out << "Reuse Distance Results (" << (1 << reuseBlockShift) << " B blocks, " << blockReuse->Accesses() << " accesses):" << endl;
+    *out << "cold : " << blockReuse->ColdMisses() << endl;
+    *out << "0 : " << blockReuse->Histogram(0) << endl;
+    for (UINT32 bin = 1; bin <= lastBin; bin++) {
+        *out << "[" << (1ULL << (bin - 1)) << ", " << (1ULL << bin) << ") : " << blockReuse->Histogram(bin) << endl;
+    }
+    *out << "Miss Ratio Curve (fully associative LRU):" << endl;
+    for (UINT32 sizeLog = 0; sizeLog <= lastBin; sizeLog++) {
+        UINT64 misses = blockReuse->Misses(sizeLog);
+        *out << ((1ULL << sizeLog) << reuseBlockShift) << " B : " << misses << " misses ("
+             << (blockReuse->Accesses() ? 100.0 * misses / blockReuse->Accesses() : 0.0) << "%)" << endl;
+    }
+
+    PrintLoadProfiles();
+    PrintRoutineProfiles();
+
+    if (KnobDataflow) {
+        PrintDataflow();
+    }
 }
 
 /*!
@@ -376,23 +2035,147 @@ VOID Fini(INT32 code, VOID* v) {
 int main(int argc, char* argv[]) {
     // Initialize PIN library. Print help message if -h(elp) is specified
     // in the command line or the command line is invalid
+    PIN_InitSymbols();
     if (PIN_Init(argc, argv)) {
         return Usage();
     }
 
     string fileName = KnobOutputFile.Value();
     fastForward = KnobFastForward.Value() * 1e9;
+    string windowError;
+    if (!windowSchedule.Init(fastForward, KnobWindowLength.Value(), KnobEvery.Value(), KnobWindows.Value(), windowError)) {
+        cerr << "Error: " << windowError << endl;
+        return Usage();
+    }
+    if (KnobBbv && KnobSnapshot.Value()) {
+        cerr << "Error: -snapshot reports window progress and cannot be combined with -bbv" << endl;
+        return Usage();
+    }
+    windowStart = windowSchedule.Start();
+    windowEnd = windowSchedule.End();
+    bbvInterval = KnobBbvInterval.Value();
+    if (KnobBbv) {
+        bbvOut = new std::ofstream((KnobBbvPrefix.Value() + ".bb").c_str());
+    }
+    analysisPhase = (windowStart == 0);
+
+    threadDataKey = PIN_CreateThreadDataKey(0);
+    PIN_InitLock(&threadListLock);
+    PIN_InitLock(&llcLock);
+    PIN_InitLock(&reportLock);
+
+    for (UINT32 i = 0; i < footprintGranularities; i++) {
+        instructionFootprint[i] = new FootprintBitmap(footprintShifts[i]);
+    }
+
+    if (KnobCachePolicy.Value() == "lru") {
+        cachePolicy = REPLACE_LRU;
+    } else if (KnobCachePolicy.Value() == "plru") {
+        cachePolicy = REPLACE_PLRU;
+    } else if (KnobCachePolicy.Value() == "rrip") {
+        cachePolicy = REPLACE_RRIP;
+    } else {
+        cerr << "Error: unknown cache replacement policy " << KnobCachePolicy.Value() << endl;
+        return Usage();
+    }
+    for (cacheLineShift = 0; (1U << cacheLineShift) < KnobCacheLine.Value(); cacheLineShift++) {
+    }
+    memoryLatency = KnobMemoryLatency.Value();
+    if ((1U << cacheLineShift) != KnobCacheLine.Value()
+        || !Cache::ValidGeometry(KnobL1DSize.Value() * 1024ULL, KnobL1DAssoc.Value(), cacheLineShift)
+        || !Cache::ValidGeometry(KnobL1ISize.Value() * 1024ULL, KnobL1IAssoc.Value(), cacheLineShift)
+        || !Cache::ValidGeometry(KnobL2Size.Value() * 1024ULL, KnobL2Assoc.Value(), cacheLineShift)
+        || !Cache::ValidGeometry(KnobLLCSize.Value() * 1024ULL, KnobLLCAssoc.Value(), cacheLineShift)) {
+        cerr << "Error: cache sizes, line size and associativities must be powers of two (at most 64 ways)" << endl;
+        return Usage();
+    }
+    CreateLlc();
+
+    if (KnobPageSize.Value() == "4k") {
+        cpiPageSize = 0;
+    } else if (KnobPageSize.Value() == "2m") {
+        cpiPageSize = 1;
+    } else {
+        cerr << "Error: unknown page size " << KnobPageSize.Value() << endl;
+        return Usage();
+    }
+    // 4 KB and 2 MB translations live in separate arrays with their own
+    // geometry, as in current x86 cores; the 2 MB defaults are Haswell's
+    TlbGeometry geometries[pageSizes][3] = {
+        {{KnobItlbEntries.Value(), KnobItlbAssoc.Value()},
+         {KnobDtlbEntries.Value(), KnobDtlbAssoc.Value()},
+         {KnobStlbEntries.Value(), KnobStlbAssoc.Value()}},
+        {{KnobItlb2mEntries.Value(), KnobItlb2mAssoc.Value()},
+         {KnobDtlb2mEntries.Value(), KnobDtlb2mAssoc.Value()},
+         {KnobStlb2mEntries.Value(), KnobStlb2mAssoc.Value()}}
+    };
+    for (UINT32 i = 0; i < pageSizes; i++) {
+        for (UINT32 level = 0; level < 3; level++) {
+            if (!TlbHierarchy::ValidGeometry(geometries[i][level])) {
+                cerr << "Error: TLB entries and associativities must be powers of two (at most 64 ways)" << endl;
+                return Usage();
+            }
+            tlbGeometries[i][level] = geometries[i][level];
+        }
+    }
+    routineProfiles.push_back(NewRoutineProfile("[unknown]", "[unknown]"));
+
+    std::istringstream windows(KnobIlpWindows.Value());
+    for (string size; std::getline(windows, size, ',');) {
+        UINT32 window = strtoul(size.c_str(), NULL, 0);
+        if (window == 0) {
+            cerr << "Error: invalid ILP window size " << size << endl;
+            return Usage();
+        }
+        ilpWindowSizes.push_back(window);
+    }
+
+    memoryBuffer = PIN_DefineTraceBuffer(sizeof(MemoryRecord), KnobBufferPages.Value(), ProcessMemoryBuffer, 0);
+    if (memoryBuffer == BUFFER_ID_INVALID) {
+        cerr << "Error: could not allocate the memory-address trace buffer" << endl;
+        return 1;
+    }
+
+    if (!KnobTrace.Value().empty() && !traceRecorder.Open(KnobTrace.Value(), KnobBufferPages.Value())) {
+        cerr << "Error: could not allocate the trace recording buffer" << endl;
+        return 1;
+    }
+
+    if (!ParseReportFormat(KnobFormat.Value(), reportFormat)) {
+        cerr << "Error: unknown output format " << KnobFormat.Value() << endl;
+        return Usage();
+    }
 
     if (!fileName.empty()) {
         out = new std::ofstream(fileName.c_str());
     }
+    snapshotOut = KnobSnapshotFile.Value().empty() ? out : new std::ofstream(KnobSnapshotFile.Value().c_str());
+    if (reportFormat == REPORT_CSV) {
+        MetricReport::WriteCsvHeader(*out);
+        if (snapshotOut != out) {
+            MetricReport::WriteCsvHeader(*snapshotOut);
+        }
+    }
 
     if (KnobCount) {
+        // Register function to be called when an application thread starts
+        PIN_AddThreadStartFunction(ThreadStart, 0);
+
         // Register function to be called to instrument traces
         TRACE_AddInstrumentFunction(Trace, 0);
 
         // Register function to be called when the application exits
         PIN_AddFiniFunction(Fini, 0);
+
+        // Register function to be called when the tool detaches after the window
+        PIN_AddDetachFunction(DetachFini, 0);
+
+        // The snapshot thread has to exit before Fini runs
+        PIN_AddPrepareForFiniFunction(PrepareForFini, 0);
+        if (KnobSnapshot.Value() && !snapshotThread.Start(KnobSnapshot.Value(), TotalInstructions, WriteSnapshot)) {
+            cerr << "Error: could not start the snapshot thread" << endl;
+            return 1;
+        }
     }
 
     cerr << "===============================================" << endl;
@@ -6,6 +6,13 @@
 #include <types.h>
 #include <array>
 #include <vector>
+#include <x86intrin.h>
+#include "aligned.h"
+#include "predictors.h"
+#include "btb.h"
+#include "tracewriter.h"
+#include "windows.h"
+#include "report.h"
 using std::cerr;
 using std::endl;
 using std::string;
@@ -16,6 +23,30 @@ using std::vector;
 // Global variables
 /* ================================================================== */
 VOID Fini(INT32 code, VOID* v);
+VOID ReportWindow(UINT32 window);
+
+// The eight direction predictors of the assignment, and TAGE and a
+// perceptron as references for what a current core would mispredict. Hybrids refer to their
+// components by position: 2 is SAg, 3 is GAg and 4 is gshare.
+typedef PredictorSet<
+    Fnbt,                    // 0
+    Bimodal<512, 2>,         // 1: 512x2 PHT
+    SAg<1024, 9, 2>,         // 2: 1024x9 BHT, 512x2 PHT
+    GAg<9, 3>,               // 3: 512x3 PHT
+    GShare<9, 3>,            // 4: 512x3 PHT
+    Tournament<2, 3, 9, 2>,  // 5: SAg or GAg, 512x2 chooser indexed by global history
+    Majority<2, 3, 4>,       // 6
+    Tournament3<2, 3, 4, 9, 2>, // 7: three 512x2 choosers indexed by global history
+    Tage<13, 12, 10, 11, 4, 640, PackedSlot<2>::VALUE>, // 8: 8Kx2 packed base, twelve 1K-entry tables with 11-bit tags, histories 4 to 640, about 26 KB
+    Perceptron<9, 128>       // 9: 512 rows of 128 int8 weights over global history, 64 KB
+> DirectionPredictors;
+const UINT32 numDirectionPredictors = DirectionPredictors::SIZE;
+
+// The two BTBs of the assignment, 128 sets of 4 ways with 15-bit partial
+// tags: BTB1 indexed by the branch address, BTB2 by the address XOR the
+// last 7 global outcomes
+typedef Btb<128, 4, 15, PcIndex> Btb1;
+typedef Btb<128, 4, 15, PcXorHistoryIndex<7> > Btb2;
 
 typedef array<UINT64,2> DirectionPredictorData;
 typedef array<UINT64,3> DirectionData; // 0 for conditional forward, 1 for conditional backward, 2 for indirect
@@ -29,284 +60,129 @@ string directionPredictorNames[] = {
     "gshare",
     "Hybrid-1",
     "Hybrid-2 Majority",
-    "Hybrid-2 Tournament"
+    "Hybrid-2 Tournament",
+    "TAGE",
+    "Perceptron"
 };
+static_assert(sizeof(directionPredictorNames) / sizeof(directionPredictorNames[0]) == numDirectionPredictors, "one name per predictor");
 
-DirectionPredictorData directionPredictorData[8];
-DirectionData directionData;
-BTBPredictorData btbPredictorData[2];
+// Predictor tables, histories and statistics are private to each application
+// thread: threads never race on them and each keeps its own branch history.
+// Fini sums the statistics over all threads. The alignment keeps one
+// thread's counters and tables from sharing a line with another's.
+struct ThreadData : CacheAligned {
+    UINT64 instructionCount = 0;
+    UINT64 windowInstructions = 0; // instructions since the current window opened
 
-INT32 bimodalPHT[512] = {0}; // 512x2 PHT
+    DirectionPredictorData directionPredictorData[numDirectionPredictors] = {};
+    DirectionData directionData = {};
+    BTBPredictorData btbPredictorData[2] = {};
+    UINT64 predictorCycles = 0; // -branch_cost: timestamp ticks spent in UpdateDirectionPredictors
 
-INT32 SAgBHT[1024] = {0};  // 1024x9 BHT
-INT32 SAgPHT[512] = {0};  // 512x2 PHT
+    DirectionPredictors directionPredictors;
 
-INT32 globalHistory = 0;  // 9 bit global history
-INT32 GAgPHT[512] = {0};  // 512x3 PHT
+    Btb1 btb1;
+    Btb2 btb2;
 
-INT32 GAgHistory = 0;  // 9 bit global history
-INT32 gsharePHT[512] = {0};  // 512x3 PHT
-
-INT32 hybrid1PHT[512] = {0};  // 512x2 PHT, indexed by global history
-
-INT32 hybrid2_SAg_GAg[512] = {0};  // 512x2 PHT, indexed by global history
-INT32 hybrid2_GAg_gshare[512] = {0};  // 512x2 PHT, indexed by global history
-INT32 hybrid2_gshare_SAg[512] = {0};  // 512x2 PHT, indexed by global history
-
-UINT64 LRUClock = 0;
-struct BTBEntry {
-    BOOL valid;
-    ADDRINT tag;
-    UINT64 LRU;
-    ADDRINT target;
+    VOID UpdateDirectionPredictors(ADDRINT instructionAddress, ADDRINT branchTarget, BOOL taken);
+    VOID UpdateBTBPrediction(ADDRINT instructionAddress, UINT32 instructionSize, ADDRINT branchTarget, BOOL taken);
 };
 
-vector<vector<BTBEntry>> BTB1(128, vector<BTBEntry>(4, {false, 0, 0, 0}));
-vector<vector<BTBEntry>> BTB2(128, vector<BTBEntry>(4, {false, 0, 0, 0}));
+TLS_KEY threadDataKey;
+PIN_LOCK threadListLock;
+vector<ThreadData*> threadList;
+
+TraceRecorder traceRecorder; // -trace: binary trace after fast-forward
 
 std::ostream* out = &cerr;
+std::ostream* snapshotOut = &cerr;
+ReportFormat reportFormat = REPORT_TEXT;
+SnapshotThread snapshotThread; // -snapshot: progress reports from an internal thread
+PIN_LOCK reportLock; // keeps snapshots away from window reports and resets
 UINT64 fastForward = 0;
+WindowSchedule windowSchedule;
+UINT64 windowStart; // bounds of the current window, cached for the analysis routines
+UINT64 windowEnd;
+ADDRINT windowOpen = 0; // set once a thread reaches windowStart, for all threads
+BOOL windowDone = false; // set after the last window
 
-UINT64 instructionCount = 0;
-ADDRINT fastForwardDone = 0;
 /* ===================================================================== */
 // Command line switches
 /* ===================================================================== */
 KNOB<string> KnobOutputFile(KNOB_MODE_WRITEONCE, "pintool", "o", "", "specify file name for MyPinTool output");
 KNOB<BOOL> KnobCount(KNOB_MODE_WRITEONCE, "pintool", "count", "1", "count instructions, basic blocks and threads in the application");
 KNOB<UINT64> KnobFastForward(KNOB_MODE_WRITEONCE, "pintool", "f", "0", "fast forward to the specified instruction count");
+KNOB<UINT64> KnobWindowLength(KNOB_MODE_WRITEONCE, "pintool", "window_length", "1000000000", "instructions in each analysis window");
+KNOB<string> KnobWindows(KNOB_MODE_WRITEONCE, "pintool", "windows", "", "comma-separated analysis windows as start[:length] in instructions, e.g. 2e9:5e8,1e10");
+KNOB<UINT64> KnobEvery(KNOB_MODE_WRITEONCE, "pintool", "every", "0", "start a window every N instructions from -f onwards (0: a single window)");
+KNOB<string> KnobFormat(KNOB_MODE_WRITEONCE, "pintool", "format", "text", "output format: text, json (one object per line) or csv");
+KNOB<UINT64> KnobSnapshot(KNOB_MODE_WRITEONCE, "pintool", "snapshot", "0", "write a progress snapshot every N instructions (0: off)");
+KNOB<string> KnobSnapshotFile(KNOB_MODE_WRITEONCE, "pintool", "snapshot_file", "", "file for the snapshots, default the -o output");
+KNOB<string> KnobTrace(KNOB_MODE_WRITEONCE, "pintool", "trace", "", "record a binary trace after fast-forward to <prefix>.static and <prefix>.<tid>.trace");
+KNOB<UINT32> KnobBufferPages(KNOB_MODE_WRITEONCE, "pintool", "buffer_pages", "256", "number of 4 KB pages in each thread's trace buffer");
+KNOB<BOOL> KnobBranchCost(KNOB_MODE_WRITEONCE, "pintool", "branch_cost", "0", "time the direction predictors with rdtsc and report cycles per conditional branch");
 
 /* ===================================================================== */
 // Instrumentation callbacks
 /* ===================================================================== */
-UINT32 CheckTerminate() { return instructionCount >= fastForward + 1'000'000'000; }
-UINT32 CheckFastForward() { return instructionCount >= fastForward && instructionCount < fastForward + 1'000'000'000; }
-VOID FastForwardDone() { fastForwardDone = 1; }
-ADDRINT IsFastForwardDone() { return fastForwardDone; }
+inline ThreadData* GetThreadData(THREADID tid) { return static_cast<ThreadData*>(PIN_GetThreadData(threadDataKey, tid)); }
+
+UINT32 CheckTerminate(THREADID tid) { return GetThreadData(tid)->instructionCount >= windowEnd; }
+// Windows are global, as in HW1: the bounds are checked against the running
+// thread's own instruction count, the window opens for every thread as soon
+// as one thread reaches its start, and it closes when one reaches its end.
+UINT32 CheckFastForward(THREADID tid) {
+    UINT64 instructionCount = GetThreadData(tid)->instructionCount;
+    return !windowOpen && instructionCount >= windowStart && instructionCount < windowEnd;
+}
+VOID FastForwardDone() { windowOpen = 1; }
+ADDRINT IsFastForwardDone(THREADID tid) { return windowOpen; }
 
-VOID CountInstruction(UINT32 count) { instructionCount += count; }
-VOID UpdateDirectionPredictors(ADDRINT instructionAddress, ADDRINT branchTarget, BOOL taken) {
-    INT32 branchType = (branchTarget > instructionAddress) ? 0 : 1; // 0 for forward, 1 for backward
-    directionData[branchType]++;
+VOID CountInstruction(THREADID tid, UINT32 count) {
+    ThreadData* data = GetThreadData(tid);
+    data->instructionCount += count;
+    data->windowInstructions += windowOpen ? count : 0;
+}
 
-    // FNBT
-    INT32 FNBT_Mispredicted = ((branchType == 0) && taken) || ((branchType == 1) && !taken);
-    directionPredictorData[0][branchType] += FNBT_Mispredicted;
-
-    // Bimodal
-    INT32 bimodalIndex = (instructionAddress & 0x1FF);
-    INT32 bimodalPrediction = bimodalPHT[bimodalIndex] >= 2;
-    INT32 bimodalMispredicted = bimodalPrediction != taken;
-    directionPredictorData[1][branchType] += bimodalMispredicted;
-
-    // SAg
-    INT32 SAgIndex = (instructionAddress & 0x3FF);
-    INT32 SAgHistory = SAgBHT[SAgIndex];
-    INT32 SAgPrediction = SAgPHT[SAgHistory] >= 2;
-    INT32 SAgMispredicted = SAgPrediction != taken;
-    directionPredictorData[2][branchType] += SAgMispredicted;
-
-    // GAg
-    INT32 GAgPrediction = GAgPHT[globalHistory] >= 4;
-    INT32 GAgMispredicted = GAgPrediction != taken;
-    directionPredictorData[3][branchType] += GAgMispredicted;
-
-    // gshare
-    INT32 gshareIndex = (instructionAddress & 0x1FF) ^ globalHistory;
-    INT32 gsharePrediction = gsharePHT[gshareIndex] >= 4;
-    INT32 gshareMispredicted = gsharePrediction != taken;
-    directionPredictorData[4][branchType] += gshareMispredicted;
-
-    // Hybrid of SAg and GAg
-    INT32 hybrid1Index = globalHistory;
-    INT32 hybrid1TournamentPrediction = hybrid1PHT[hybrid1Index] >= 2;
-    INT32 hybrid1Prediction = (hybrid1TournamentPrediction) ? GAgPrediction : SAgPrediction;
-    INT32 hybrid1Mispredicted = hybrid1Prediction != taken;
-    directionPredictorData[5][branchType] += hybrid1Mispredicted;
-
-    // Hybrid of SAg, GAg, gshare (Majority)
-    INT32 hybrid2_MajorityPrediction = (SAgPrediction + GAgPrediction + gsharePrediction) >= 2;
-    INT32 hybrid2_MajorityMispredicted = hybrid2_MajorityPrediction != taken;
-    directionPredictorData[6][branchType] += hybrid2_MajorityMispredicted;
-
-    // Hybrid of SAg, GAg, gshare (Tournament)
-    INT32 hybrid2Index = globalHistory;
-    INT32 hybrid2_SAg_GAgPrediction = hybrid2_SAg_GAg[hybrid2Index] >= 2;
-    INT32 hybrid2_TournamentPrediction;
-    if (hybrid2_SAg_GAgPrediction) { // GAg
-        hybrid2_TournamentPrediction = (hybrid2_GAg_gshare[hybrid2Index] >= 2) ? gsharePrediction : GAgPrediction;
-    } else { // SAg
-        hybrid2_TournamentPrediction = (hybrid2_gshare_SAg[hybrid2Index] >= 2) ? SAgPrediction : gsharePrediction;
-    }
-    INT32 hybrid2_TournamentMispredicted = hybrid2_TournamentPrediction != taken;
-    directionPredictorData[7][branchType] += hybrid2_TournamentMispredicted;
-
-    // Update all predictors
-    // Update bimodal
-    if (taken && bimodalPHT[bimodalIndex] < 3) {
-        bimodalPHT[bimodalIndex]++;
-    } else if (!taken && bimodalPHT[bimodalIndex] > 0) {
-        bimodalPHT[bimodalIndex]--;
-    }
-    // Update SAg
-    if (taken && SAgPHT[SAgHistory] < 3) {
-        SAgPHT[SAgHistory]++;
-    } else if (!taken && SAgPHT[SAgHistory] > 0) {
-        SAgPHT[SAgHistory]--;
-    }
-    SAgBHT[SAgIndex] = ((SAgBHT[SAgIndex] << 1) | taken) & 0x1FF;
-    // Update GAg
-    if (taken && GAgPHT[globalHistory] < 7) {
-        GAgPHT[globalHistory]++;
-    } else if (!taken && GAgPHT[globalHistory] > 0) {
-        GAgPHT[globalHistory]--;
-    }
-    globalHistory = ((globalHistory << 1) | taken) & 0x1FF;
-    // Update gshare
-    if (taken && gsharePHT[gshareIndex] < 7) {
-        gsharePHT[gshareIndex]++;
-    } else if (!taken && gsharePHT[gshareIndex] > 0) {
-        gsharePHT[gshareIndex]--;
-    }
-    // Update Hybrid of SAg and GAg
-    if (SAgMispredicted != GAgMispredicted) {
-        if (SAgMispredicted) {
-            if (hybrid1PHT[hybrid1Index] < 3) {
-                hybrid1PHT[hybrid1Index]++;
-            }
-        } else {
-            if (hybrid1PHT[hybrid1Index] > 0) {
-                hybrid1PHT[hybrid1Index]--;
-            }
-        }
-    }
-    // Update Hybrid of SAg, GAg, gshare (Majority)
-    if (SAgMispredicted != GAgMispredicted) {
-        if (SAgMispredicted) {
-            if (hybrid2_SAg_GAg[hybrid2Index] < 3) {
-                hybrid2_SAg_GAg[hybrid2Index]++;
-            }
-        } else {
-            if (hybrid2_SAg_GAg[hybrid2Index] > 0) {
-                hybrid2_SAg_GAg[hybrid2Index]--;
-            }
-        }
-    }
-    if (GAgMispredicted != gshareMispredicted) {
-        if (GAgMispredicted) {
-            if (hybrid2_GAg_gshare[hybrid2Index] < 3) {
-                hybrid2_GAg_gshare[hybrid2Index]++;
-            }
-        } else {
-            if (hybrid2_GAg_gshare[hybrid2Index] > 0) {
-                hybrid2_GAg_gshare[hybrid2Index]--;
-            }
-        }
-    }
-    if (gshareMispredicted != SAgMispredicted) {
-        if (gshareMispredicted) {
-            if (hybrid2_gshare_SAg[hybrid2Index] < 3) {
-                hybrid2_gshare_SAg[hybrid2Index]++;
-            }
-        } else {
-            if (hybrid2_gshare_SAg[hybrid2Index] > 0) {
-                hybrid2_gshare_SAg[hybrid2Index]--;
-            }
-        }
-    }
+VOID ConditionalBranchAnalysis(THREADID tid, ADDRINT instructionAddress, ADDRINT branchTarget, BOOL taken) {
+    GetThreadData(tid)->UpdateDirectionPredictors(instructionAddress, branchTarget, taken);
 }
 
-VOID UpdateBTBPrediction(ADDRINT instructionAddress, UINT32 instructionSize, ADDRINT branchTarget, BOOL taken) {
-    directionData[2]++;
-    
-    // BTB1
-    ADDRINT BTB1Index = instructionAddress & 0x7F;
-    ADDRINT BTB1Tag = instructionAddress >> 7;
-    INT32 BTB1Way = -1;
-
-    for (INT32 i = 0; i < 4; i++) {
-        if (BTB1[BTB1Index][i].valid && BTB1[BTB1Index][i].tag == BTB1Tag) {
-            BTB1Way = i;
-            break;
-        }
-    }
+// -branch_cost: the same update between two timestamp reads. The count
+// includes the reads themselves, so compare runs rather than trusting the
+// absolute number.
+VOID TimedConditionalBranchAnalysis(THREADID tid, ADDRINT instructionAddress, ADDRINT branchTarget, BOOL taken) {
+    ThreadData* data = GetThreadData(tid);
+    UINT64 start = __rdtsc();
+    data->UpdateDirectionPredictors(instructionAddress, branchTarget, taken);
+    data->predictorCycles += __rdtsc() - start;
+}
 
-    if (BTB1Way == -1) {
-        // Miss
-        btbPredictorData[0][1]++;
-        btbPredictorData[0][0]++;
-        for (INT32 i = 0; i < 4; i++) {
-            if (!BTB1[BTB1Index][i].valid) {
-                BTB1Way = i;
-                break;
-            }
-        }
-        if (BTB1Way == -1) {
-            BTB1Way = 0;
-            for (INT32 i = 1; i < 4; i++) {
-                if (BTB1[BTB1Index][i].LRU < BTB1[BTB1Index][BTB1Way].LRU) {
-                    BTB1Way = i;
-                }
-            }
-        }
-        BTB1[BTB1Index][BTB1Way].valid = true;
-        BTB1[BTB1Index][BTB1Way].tag = BTB1Tag;
-        BTB1[BTB1Index][BTB1Way].target = branchTarget;
-        BTB1[BTB1Index][BTB1Way].LRU = LRUClock++;
-    } else {
-        // Hit
-        if (BTB1[BTB1Index][BTB1Way].target != branchTarget) {
-            btbPredictorData[0][0]++; // mispredict
-            BTB1[BTB1Index][BTB1Way].target = branchTarget;
-        } else if (!taken) {
-            btbPredictorData[0][0]++; // mispredict
-        }
-        BTB1[BTB1Index][BTB1Way].LRU = LRUClock++;
-    }
+VOID IndirectBranchAnalysis(THREADID tid, ADDRINT instructionAddress, UINT32 instructionSize, ADDRINT branchTarget, BOOL taken) {
+    GetThreadData(tid)->UpdateBTBPrediction(instructionAddress, instructionSize, branchTarget, taken);
+}
 
-    // BTB2
-    ADDRINT BTB2Index = (instructionAddress & 0x7F) ^ (globalHistory & 0x7F);
-    ADDRINT BTB2Tag = instructionAddress;
-    INT32 BTB2Way = -1;
+VOID ThreadData::UpdateDirectionPredictors(ADDRINT instructionAddress, ADDRINT branchTarget, BOOL taken) {
+    INT32 branchType = (branchTarget > instructionAddress) ? 0 : 1; // 0 for forward, 1 for backward
+    directionData[branchType]++;
 
-    for (INT32 i = 0; i < 4; i++) {
-        if (BTB2[BTB2Index][i].valid && BTB2[BTB2Index][i].tag == BTB2Tag) {
-            BTB2Way = i;
-            break;
-        }
+    BOOL mispredicted[numDirectionPredictors];
+    directionPredictors.Access(instructionAddress, branchTarget, taken, mispredicted);
+    for (UINT32 i = 0; i < numDirectionPredictors; i++) {
+        directionPredictorData[i][branchType] += mispredicted[i];
     }
+}
 
-    if (BTB2Way == -1) {
-        // Miss
-        btbPredictorData[1][1]++;
-        btbPredictorData[1][0]++;
-        for (INT32 i = 0; i < 4; i++) {
-            if (!BTB2[BTB2Index][i].valid) {
-                BTB2Way = i;
-                break;
-            }
-        }
-        if (BTB2Way == -1) {
-            BTB2Way = 0;
-            for (INT32 i = 1; i < 4; i++) {
-                if (BTB2[BTB2Index][i].LRU < BTB2[BTB2Index][BTB2Way].LRU) {
-                    BTB2Way = i;
-                }
-            }
-        }
-        BTB2[BTB2Index][BTB2Way].valid = true;
-        BTB2[BTB2Index][BTB2Way].tag = BTB2Tag;
-        BTB2[BTB2Index][BTB2Way].target = branchTarget;
-        BTB2[BTB2Index][BTB2Way].LRU = LRUClock++;
-    } else {
-        // Hit
-        if (BTB2[BTB2Index][BTB2Way].target != branchTarget) {
-            btbPredictorData[1][0]++; // mispredict
-            BTB2[BTB2Index][BTB2Way].target = branchTarget;
-        } else if (!taken) {
-            btbPredictorData[1][0]++; // mispredict
-        }
-        BTB2[BTB2Index][BTB2Way].LRU = LRUClock++;
+VOID ThreadData::UpdateBTBPrediction(ADDRINT instructionAddress, UINT32 instructionSize, ADDRINT branchTarget, BOOL taken) {
+    directionData[2]++;
+
+    BtbOutcome outcomes[2] = {
+        btb1.Access(instructionAddress, 0, branchTarget, taken),
+        btb2.Access(instructionAddress, directionPredictors.History(), branchTarget, taken)
+    };
+    for (UINT32 i = 0; i < 2; i++) {
+        btbPredictorData[i][0] += outcomes[i] != BTB_HIT;
+        btbPredictorData[i][1] += outcomes[i] == BTB_MISS;
     }
 }
 /* ===================================================================== */
@@ -327,18 +203,68 @@ INT32 Usage() {
 }
 
 VOID InstrumentConditionalBranch(INS ins) {
-    INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR) IsFastForwardDone, IARG_END);
-    INS_InsertThenCall(ins, IPOINT_BEFORE, (AFUNPTR) UpdateDirectionPredictors, IARG_INST_PTR, IARG_BRANCH_TARGET_ADDR, IARG_BRANCH_TAKEN, IARG_END);
+    AFUNPTR analysis = KnobBranchCost ? (AFUNPTR) TimedConditionalBranchAnalysis : (AFUNPTR) ConditionalBranchAnalysis;
+    INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR) IsFastForwardDone, IARG_THREAD_ID, IARG_END);
+    INS_InsertThenCall(ins, IPOINT_BEFORE, analysis, IARG_THREAD_ID, IARG_INST_PTR, IARG_BRANCH_TARGET_ADDR, IARG_BRANCH_TAKEN, IARG_END);
 }
 
 VOID InstrumentIndirectControlTransfer(INS ins) {
-    INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR) IsFastForwardDone, IARG_END);
-    INS_InsertThenCall(ins, IPOINT_BEFORE, (AFUNPTR) UpdateBTBPrediction, IARG_INST_PTR, IARG_UINT32, INS_Size(ins), IARG_BRANCH_TARGET_ADDR, IARG_BRANCH_TAKEN, IARG_END);
+    INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR) IsFastForwardDone, IARG_THREAD_ID, IARG_END);
+    INS_InsertThenCall(ins, IPOINT_BEFORE, (AFUNPTR) IndirectBranchAnalysis, IARG_THREAD_ID, IARG_INST_PTR, IARG_UINT32, INS_Size(ins), IARG_BRANCH_TARGET_ADDR, IARG_BRANCH_TAKEN, IARG_END);
 }
 
-VOID Terminate() {
-    Fini(0, 0);
-    exit(0);
+VOID ThreadStart(THREADID tid, CONTEXT* ctxt, INT32 flags, VOID* v) {
+    ThreadData* data = new ThreadData;
+    PIN_SetThreadData(threadDataKey, data, tid);
+
+    PIN_GetLock(&threadListLock, tid + 1);
+    threadList.push_back(data);
+    PIN_ReleaseLock(&threadListLock);
+}
+
+// Clears the statistics between windows. Predictor tables, histories and
+// BTBs are left as they are, so each window starts from warm predictors.
+VOID ResetStatistics() {
+    windowOpen = 0;
+    PIN_GetLock(&threadListLock, 0);
+    for (ThreadData* data : threadList) {
+        data->windowInstructions = 0;
+        for (UINT32 i = 0; i < numDirectionPredictors; i++) {
+            data->directionPredictorData[i].fill(0);
+        }
+        data->directionData.fill(0);
+        data->predictorCycles = 0;
+        for (UINT32 i = 0; i < 2; i++) {
+            data->btbPredictorData[i].fill(0);
+        }
+    }
+    PIN_ReleaseLock(&threadListLock);
+}
+
+// The window is over. Every window but the last is reported and cleared here
+// with the other threads stopped, so none of them is half-way through a
+// predictor update; the last one is reported by Fini, which runs from the
+// exit path after Pin has flushed the trace buffers.
+VOID EndWindow(THREADID tid) {
+    if (!PIN_StopApplicationThreads(tid, PIN_INFINITE_TIMEOUT)) {
+        return;
+    }
+    BOOL ended = !windowDone && GetThreadData(tid)->instructionCount >= windowEnd;
+    BOOL more = ended && windowSchedule.Next();
+    PIN_GetLock(&reportLock, tid + 1);
+    if (more) {
+        ReportWindow(windowSchedule.Index() - 1);
+        ResetStatistics();
+        windowStart = windowSchedule.Start();
+        windowEnd = windowSchedule.End();
+    } else if (ended) {
+        windowDone = true;
+    }
+    PIN_ReleaseLock(&reportLock);
+    PIN_ResumeApplicationThreads(tid);
+    if (ended && !more) {
+        PIN_ExitApplication(0);
+    }
 }
 
 /* ===================================================================== */
@@ -346,12 +272,16 @@ VOID Terminate() {
 /* ===================================================================== */
 VOID Trace(TRACE trace, VOID* v) {
     for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
-        BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR) CheckTerminate, IARG_END);
-        BBL_InsertThenCall(bbl, IPOINT_BEFORE, (AFUNPTR) Terminate, IARG_END);
+        BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR) CheckTerminate, IARG_THREAD_ID, IARG_END);
+        BBL_InsertThenCall(bbl, IPOINT_BEFORE, (AFUNPTR) EndWindow, IARG_THREAD_ID, IARG_END);
 
-        BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR) CheckFastForward, IARG_END);
+        BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR) CheckFastForward, IARG_THREAD_ID, IARG_END);
         BBL_InsertThenCall(bbl, IPOINT_BEFORE, (AFUNPTR) FastForwardDone, IARG_END);
 
+        if (traceRecorder.Enabled()) {
+            traceRecorder.InstrumentBbl(bbl, (AFUNPTR) IsFastForwardDone);
+        }
+
         for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
             if (INS_IsBranch(ins) && INS_HasFallThrough(ins)) {
                 InstrumentConditionalBranch(ins);
@@ -360,10 +290,90 @@ VOID Trace(TRACE trace, VOID* v) {
             }
         }
 
-        BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR) CountInstruction, IARG_UINT32, BBL_NumIns(bbl), IARG_END);
+        BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR) CountInstruction, IARG_THREAD_ID, IARG_UINT32, BBL_NumIns(bbl), IARG_END);
+    }
+}
+
+// Statistics summed over all threads
+struct BranchTotals {
+    UINT64 instructionCount = 0;
+    UINT64 windowInstructions = 0;
+    DirectionPredictorData directionPredictorData[numDirectionPredictors] = {};
+    DirectionData directionData = {};
+    BTBPredictorData btbPredictorData[2] = {};
+    UINT64 predictorCycles = 0;
+};
+
+BranchTotals SumThreads() {
+    BranchTotals totals;
+    PIN_GetLock(&threadListLock, 0);
+    for (ThreadData* data : threadList) {
+        totals.instructionCount += data->instructionCount;
+        totals.windowInstructions += data->windowInstructions;
+        totals.predictorCycles += data->predictorCycles;
+        for (UINT32 i = 0; i < 3; i++) {
+            totals.directionData[i] += data->directionData[i];
+        }
+        for (UINT32 i = 0; i < numDirectionPredictors; i++) {
+            for (UINT32 j = 0; j < 2; j++) {
+                totals.directionPredictorData[i][j] += data->directionPredictorData[i][j];
+            }
+        }
+        for (UINT32 i = 0; i < 2; i++) {
+            for (UINT32 j = 0; j < 2; j++) {
+                totals.btbPredictorData[i][j] += data->btbPredictorData[i][j];
+            }
+        }
+    }
+    PIN_ReleaseLock(&threadListLock);
+    return totals;
+}
+
+// The numbers of the text report, for -format json and csv and the snapshots
+VOID AddBranchMetrics(MetricReport& report, const BranchTotals& totals) {
+    report.Add("total", "instructions", totals.instructionCount);
+    report.Add("total", "window_instructions", totals.windowInstructions);
+    report.Add("total", "forward_branches", totals.directionData[0]);
+    report.Add("total", "backward_branches", totals.directionData[1]);
+    report.Add("total", "indirect_branches", totals.directionData[2]);
+    UINT64 conditional = totals.directionData[0] + totals.directionData[1];
+    for (UINT32 i = 0; i < numDirectionPredictors; i++) {
+        string group = MetricName(directionPredictorNames[i]);
+        UINT64 mispredictions = totals.directionPredictorData[i][0] + totals.directionPredictorData[i][1];
+        report.Add(group, "mispredictions", mispredictions);
+        report.Add(group, "misprediction_rate", 1.0 * mispredictions / conditional);
+        report.Add(group, "forward_mispredictions", totals.directionPredictorData[i][0]);
+        report.Add(group, "backward_mispredictions", totals.directionPredictorData[i][1]);
+    }
+    for (UINT32 i = 0; i < 2; i++) {
+        string group = "btb" + std::to_string(i + 1);
+        report.Add(group, "mispredictions", totals.btbPredictorData[i][0]);
+        report.Add(group, "misses", totals.btbPredictorData[i][1]);
+        report.Add(group, "misprediction_rate", 1.0 * totals.btbPredictorData[i][0] / totals.directionData[2]);
+    }
+    if (KnobBranchCost) {
+        report.Add("cost", "predictor_cycles", totals.predictorCycles);
+        report.Add("cost", "cycles_per_branch", 1.0 * totals.predictorCycles / conditional);
     }
 }
 
+UINT64 TotalInstructions() { return SumThreads().instructionCount; }
+
+// Runs on the snapshot thread; the counters are read while the application
+// threads keep updating them, so a snapshot can be off by a few branches
+VOID WriteSnapshot(UINT32 index, UINT64 instructions, UINT64 seconds) {
+    BranchTotals totals = SumThreads();
+    PIN_GetLock(&reportLock, PIN_ThreadId() + 1);
+    MetricReport report("snapshot", windowSchedule.Index());
+    report.Add("progress", "snapshot", index);
+    report.Add("progress", "seconds", seconds);
+    AddBranchMetrics(report, totals);
+    report.Write(*snapshotOut, reportFormat);
+    PIN_ReleaseLock(&reportLock);
+}
+
+VOID PrepareForFini(VOID* v) { snapshotThread.Stop(); }
+
 /*!
  * Print out analysis results.
  * This function is called when the application exits.
@@ -372,10 +382,40 @@ VOID Trace(TRACE trace, VOID* v) {
  *                              PIN_AddFiniFunction function call
  */
 VOID Fini(INT32 code, VOID* v) {
+    if (traceRecorder.Enabled()) {
+        traceRecorder.Close();
+    }
+
+    // Nothing to report if the run ended between two windows
+    if (windowOpen || windowSchedule.Index() == 0) {
+        ReportWindow(windowSchedule.Index());
+    }
+}
+
+VOID ReportWindow(UINT32 window) {
+    BranchTotals totals = SumThreads();
+    if (reportFormat != REPORT_TEXT) {
+        MetricReport report("window", window);
+        report.Add("window", "start", windowStart);
+        report.Add("window", "end", windowEnd);
+        AddBranchMetrics(report, totals);
+        report.Write(*out, reportFormat);
+        return;
+    }
+
+    UINT64 instructionCount = totals.windowInstructions;
+    const DirectionPredictorData* directionPredictorData = totals.directionPredictorData;
+    const DirectionData& directionData = totals.directionData;
+    const BTBPredictorData* btbPredictorData = totals.btbPredictorData;
+
+    if (windowSchedule.Multiple()) {
+        *out << "===============================================" << endl;
+        *out << "Window " << window << " : instructions [" << windowStart << ", " << windowEnd << ")" << endl;
+    }
     *out << "Total instructions: " << instructionCount << endl;
     *out << "===============================================" << endl;
     *out << "Direction Predictors" << endl;
-    for (UINT32 i = 0; i < 8; i++) {
+    for (UINT32 i = 0; i < numDirectionPredictors; i++) {
         *out << directionPredictorNames[i] << ": ";
         *out << "Accesses " << directionData[0] + directionData[1] << ", ";
         *out << "Mispredictions " << directionPredictorData[i][0] + directionPredictorData[i][1] << " (" << ((directionPredictorData[i][0] + directionPredictorData[i][1]) * 100.0f / ((directionData[0] + directionData[1]) * 1.0f)) << "), ";
@@ -384,6 +424,9 @@ VOID Fini(INT32 code, VOID* v) {
         *out << "Backward Branches " << directionData[1] << ", ";
         *out << "Backward Mispredictions " << directionPredictorData[i][1] << " (" << ((directionPredictorData[i][1] * 100.0f / directionData[1] * 1.0f)) << ")" << endl;
     }
+    if (KnobBranchCost) {
+        *out << "Direction predictor cost: " << totals.predictorCycles * 1.0 / (directionData[0] + directionData[1]) << " cycles per branch" << endl;
+    }
     *out << endl;
 
     *out << "BTB Predictors" << endl;
@@ -410,17 +453,55 @@ int main(int argc, char* argv[]) {
 
     string fileName = KnobOutputFile.Value();
     fastForward = KnobFastForward.Value() * 1e9;
+    string windowError;
+    if (!windowSchedule.Init(fastForward, KnobWindowLength.Value(), KnobEvery.Value(), KnobWindows.Value(), windowError)) {
+        cerr << "Error: " << windowError << endl;
+        return Usage();
+    }
+    windowStart = windowSchedule.Start();
+    windowEnd = windowSchedule.End();
+
+    if (!KnobTrace.Value().empty() && !traceRecorder.Open(KnobTrace.Value(), KnobBufferPages.Value())) {
+        cerr << "Error: could not allocate the trace recording buffer" << endl;
+        return 1;
+    }
+
+    if (!ParseReportFormat(KnobFormat.Value(), reportFormat)) {
+        cerr << "Error: unknown output format " << KnobFormat.Value() << endl;
+        return Usage();
+    }
 
     if (!fileName.empty()) {
         out = new std::ofstream(fileName.c_str());
     }
+    snapshotOut = KnobSnapshotFile.Value().empty() ? out : new std::ofstream(KnobSnapshotFile.Value().c_str());
+    if (reportFormat == REPORT_CSV) {
+        MetricReport::WriteCsvHeader(*out);
+        if (snapshotOut != out) {
+            MetricReport::WriteCsvHeader(*snapshotOut);
+        }
+    }
+
+    threadDataKey = PIN_CreateThreadDataKey(0);
+    PIN_InitLock(&threadListLock);
+    PIN_InitLock(&reportLock);
 
     if (KnobCount) {
+        // Register function to be called when an application thread starts
+        PIN_AddThreadStartFunction(ThreadStart, 0);
+
         // Register function to be called to instrument traces
         TRACE_AddInstrumentFunction(Trace, 0);
 
         // Register function to be called when the application exits
         PIN_AddFiniFunction(Fini, 0);
+
+        // The snapshot thread has to exit before Fini runs
+        PIN_AddPrepareForFiniFunction(PrepareForFini, 0);
+        if (KnobSnapshot.Value() && !snapshotThread.Start(KnobSnapshot.Value(), TotalInstructions, WriteSnapshot)) {
+            cerr << "Error: could not start the snapshot thread" << endl;
+            return 1;
+        }
     }
 
     cerr << "===============================================" << endl;
@@ -0,0 +1,17 @@
+/* ALU-bound loop: adds, logicals and shifts with no memory traffic */
+#include <stdio.h>
+
+int main (void)
+{
+  unsigned int a = 1, b = 0x9e3779b9, c = 0;
+  int i;
+
+  for (i = 0; i < 2000000; i++) {
+    a = a + b;
+    b = b ^ (a << 3);
+    c = c + (a >> 5) - (b & 0xff);
+    a = a | (c >> 7);
+  }
+  printf ("alu: %u %u %u\n", a, b, c);
+  return 0;
+}
@@ -0,0 +1,17 @@
+/* Branchy: data-dependent branches driven by a pseudo-random sequence */
+#include <stdio.h>
+
+int main (void)
+{
+  unsigned int x = 12345;
+  int i, odd = 0, big = 0, both = 0;
+
+  for (i = 0; i < 1000000; i++) {
+    x = x * 1103515245 + 12345;
+    if (x & 0x10000) odd++;
+    if ((x >> 20) > 2048) big++;
+    else if ((x & 0x300) == 0x300) both++;
+  }
+  printf ("branch: %d %d %d\n", odd, big, both);
+  return 0;
+}
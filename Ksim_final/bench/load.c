@@ -0,0 +1,21 @@
+/* Load-heavy: repeated reduction over an array that fits in memory */
+#include <stdio.h>
+
+#define N 4096
+
+int data[N];
+
+int main (void)
+{
+  int i, pass;
+  int sum = 0;
+
+  for (i = 0; i < N; i++) data[i] = i;
+  for (pass = 0; pass < 200; pass++) {
+    for (i = 0; i < N; i += 4) {
+      sum += data[i] + data[i+1] + data[i+2] + data[i+3];
+    }
+  }
+  printf ("load: %d\n", sum);
+  return 0;
+}
@@ -0,0 +1,16 @@
+/* Multiply/divide: exercises the hi/lo path */
+#include <stdio.h>
+
+int main (void)
+{
+  unsigned int p = 1, q = 0;
+  int i;
+
+  for (i = 1; i < 500000; i++) {
+    p = p * 2654435761u + i;
+    q += p / (unsigned int)(i | 1);
+    q ^= p % 97;
+  }
+  printf ("muldiv: %u %u\n", p, q);
+  return 0;
+}
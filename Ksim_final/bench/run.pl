@@ -0,0 +1,161 @@
+#!/usr/bin/perl
+#
+# Ksim throughput benchmarks.
+#
+# Runs each guest program in this directory under the simulator and reports
+#   - simulated instructions per host second
+#   - host cycles per simulated cycle (needs `perf', otherwise omitted)
+#   - peak RSS of the simulator (needs GNU time)
+# Results go to results.json. With -record they also become the new
+# baseline.json; otherwise they are compared against baseline.json and the
+# script exits non-zero when a benchmark is slower or bigger than the
+# tolerance allows.
+#
+# The guests are built like any other Ksim program (extract.pl followed by
+# the usual image conversion); run.pl expects <bench>.image next to <bench>.c.
+#
+# To compare pipelines, record with one and check the other against it,
+# with configs that differ only in Mipc.Pipeline:
+#   run.pl -c diag.conf -record; run.pl -c fast.conf
+#
+
+use Time::HiRes qw(time);
+use JSON::PP;
+
+my $usage = "usage: run.pl [-sim <mipc>] [-c <conf>] [-record] [-tol <percent>] [bench ...]\n";
+
+my $sim = "../mipc";
+my $conf = "";
+my $record = 0;
+my $tol = 10;
+my @benches = ();
+
+while (@ARGV) {
+  my $arg = shift @ARGV;
+  if ($arg eq "-sim") {
+    $sim = shift @ARGV;
+  } elsif ($arg eq "-c") {
+    $conf = shift @ARGV;
+  } elsif ($arg eq "-record") {
+    $record = 1;
+  } elsif ($arg eq "-tol") {
+    $tol = shift @ARGV;
+  } elsif ($arg =~ /^-/) {
+    die ($usage);
+  } else {
+    push (@benches, $arg);
+  }
+}
+@benches = qw(alu load store branch muldiv syscall) unless (@benches);
+
+die ("Simulator $sim does not exist!\n") unless (-x $sim);
+
+my $have_time = (-x "/usr/bin/time");
+my $have_perf = (`which perf 2>/dev/null` ne "");
+
+my %results = ();
+
+foreach $bench (@benches) {
+  die ("File $bench.c does not exist!\n") unless (-e "$bench.c");
+  die ("File $bench.image does not exist, build it first!\n") unless (-e "$bench.image");
+
+  my $cmd = "$sim -l $bench.log";
+  $cmd .= " -c $conf" if ($conf ne "");
+  $cmd .= " $bench > $bench.out";
+  $cmd = "perf stat -x, -e cycles -o $bench.perf $cmd" if ($have_perf);
+  $cmd = "/usr/bin/time -f %M -o $bench.rss $cmd" if ($have_time);
+
+  my $start = time ();
+  system ($cmd);
+  my $wall = time () - $start;
+  die ("$bench: simulator failed\n") if ($? != 0);
+
+  my ($insts, $cycles) = (0, 0);
+  open (LOG, "$bench.log") || die ("Can't open $bench.log!\n");
+  while (<LOG>) {
+    $insts = $1 if (/Number of instructions: (\d+)/);
+    $cycles = $1 if (/Number of simulated cycles: (\d+)/);
+  }
+  close (LOG);
+  die ("$bench: no statistics in $bench.log\n") unless ($insts && $cycles);
+
+  my %r = (
+    instructions => $insts + 0,
+    cycles => $cycles + 0,
+    wall_seconds => $wall,
+    sim_ips => $insts / $wall,
+  );
+
+  if ($have_perf && open (PERF, "$bench.perf")) {
+    while (<PERF>) {
+      my @f = split (/,/);
+      if ($f[2] =~ /cycles/ && $f[0] =~ /^\d+$/) {
+        $r{host_cycles_per_sim_cycle} = $f[0] / $cycles;
+      }
+    }
+    close (PERF);
+  }
+  if ($have_time && open (RSS, "$bench.rss")) {
+    while (<RSS>) {
+      $r{peak_rss_kb} = $1 + 0 if (/^(\d+)\s*$/);
+    }
+    close (RSS);
+  }
+  `rm -f $bench.perf $bench.rss`;
+
+  printf ("%-8s %12d insts %12d cycles %10.0f inst/s", $bench, $insts, $cycles, $r{sim_ips});
+  printf (" %8.1f hcyc/cyc", $r{host_cycles_per_sim_cycle}) if (exists $r{host_cycles_per_sim_cycle});
+  printf (" %8d KB", $r{peak_rss_kb}) if (exists $r{peak_rss_kb});
+  print "\n";
+
+  $results{$bench} = \%r;
+}
+
+my $json = JSON::PP->new->canonical->pretty;
+
+open (OUTPUT, ">results.json") || die ("File results.json can not be opened!");
+print OUTPUT $json->encode (\%results);
+close (OUTPUT);
+
+if ($record) {
+  `cp results.json baseline.json`;
+  print "Recorded new baseline.json\n";
+  exit (0);
+}
+
+if (!-e "baseline.json") {
+  print "No baseline.json, run with -record to create one\n";
+  exit (0);
+}
+
+open (BASE, "baseline.json") || die ("Can't open baseline.json!\n");
+my $baseline = $json->decode (join ("", <BASE>));
+close (BASE);
+
+#
+# Slower throughput, more host cycles or more memory than the baseline by
+# more than $tol percent is a regression.
+#
+my $fail = 0;
+foreach $bench (sort keys %results) {
+  next unless (exists $baseline->{$bench});
+  my $new = $results{$bench};
+  my $old = $baseline->{$bench};
+
+  if ($new->{instructions} != $old->{instructions}) {
+    print "$bench: instruction count changed ($old->{instructions} -> $new->{instructions})\n";
+  }
+  if ($new->{sim_ips} < $old->{sim_ips} * (1 - $tol/100)) {
+    printf ("%s: REGRESSION sim_ips %.0f -> %.0f\n", $bench, $old->{sim_ips}, $new->{sim_ips});
+    $fail = 1;
+  }
+  foreach $key (qw(host_cycles_per_sim_cycle peak_rss_kb)) {
+    next unless (exists $old->{$key} && exists $new->{$key});
+    if ($new->{$key} > $old->{$key} * (1 + $tol/100)) {
+      printf ("%s: REGRESSION %s %.1f -> %.1f\n", $bench, $key, $old->{$key}, $new->{$key});
+      $fail = 1;
+    }
+  }
+}
+print "No regressions against baseline.json\n" unless ($fail);
+exit ($fail);
@@ -0,0 +1,22 @@
+/* Store-heavy: repeated fills of an array */
+#include <stdio.h>
+
+#define N 4096
+
+int data[N];
+
+int main (void)
+{
+  int i, pass;
+
+  for (pass = 0; pass < 200; pass++) {
+    for (i = 0; i < N; i += 4) {
+      data[i] = pass;
+      data[i+1] = pass + 1;
+      data[i+2] = pass + 2;
+      data[i+3] = pass + 3;
+    }
+  }
+  printf ("store: %d %d\n", data[0], data[N-1]);
+  return 0;
+}
@@ -0,0 +1,14 @@
+/* Syscall-heavy: every iteration drains the pipeline for an emulated call */
+#include <stdio.h>
+#include <unistd.h>
+
+int main (void)
+{
+  int i, sum = 0;
+
+  for (i = 0; i < 20000; i++) {
+    sum += getpid () & 1;
+  }
+  printf ("syscall: %d\n", sum);
+  return 0;
+}
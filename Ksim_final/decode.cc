@@ -1,4 +1,6 @@
 #include "decode.h"
+#include "pipeline.h"
+#include "profiler.h"
 
 Decode::Decode (Mipc *mc)
 {
@@ -7,8 +9,9 @@ Decode::Decode (Mipc *mc)
 
 Decode::~Decode (void) {}
 
-void
-Decode::MainLoop (void)
+template <class P>
+static void
+DecodeLoop (Mipc *_mc)
 {
    unsigned int ins;
    unsigned int pc;
@@ -52,77 +55,69 @@ Decode::MainLoop (void)
          _mc->_isInterlock = FALSE;
          
          unsigned int ready_cycles = _mc->_id_ex->Dec(_mc, _mc->_ex_mem, _mc->_mem_wb, _mc->_id_ex->_ins);
-#ifdef MIPC_DEBUG
-         fprintf(_mc->_debugLog, "<%llu> ID Received instruction %#x, PC %#x src1 = %d src2 = %d dst = %d src3 = %d\n", SIM_TIME, ins, pc, _mc->_id_ex->_src1, _mc->_id_ex->_src2, _mc->_id_ex->_decodedDST, _mc->_id_ex->_src3);
-#endif         
+         MIPC_TRACE(P, _mc, "<%llu> ID Received instruction %#x, PC %#x src1 = %d src2 = %d dst = %d src3 = %d\n", SIM_TIME, ins, pc, _mc->_id_ex->_src1, _mc->_id_ex->_src2, _mc->_id_ex->_decodedDST, _mc->_id_ex->_src3);
 
          if (_mc->_id_ex->_isSyscall) {
             _mc->_isStall = TRUE;
             _mc->_isSyscall = TRUE;
-#ifdef MIPC_DEBUG
-         fprintf(_mc->_debugLog, "<%llu> Decoded instruction %#x to be SYSCALL\n", SIM_TIME, _mc->_id_ex->_ins);
-#endif         
+            if (P::Stats::enabled) _mc->_profiler->Retire (pc, ins, SIM_TIME);
+            MIPC_TRACE(P, _mc, "<%llu> Decoded instruction %#x to be SYSCALL\n", SIM_TIME, _mc->_id_ex->_ins);
          } else if ((_mc->_id_ex->_src1 != 0 && _mc->_gprReadyCycles[_mc->_id_ex->_src1] > 0) ||
                      (_mc->_id_ex->_src2 != 0 && _mc->_gprReadyCycles[_mc->_id_ex->_src2] > 0) ||
                      (_mc->_id_ex->_src3 != 0 && _mc->_gprReadyCycles[_mc->_id_ex->_src3] > 0)) {
             int valid = 1;
-            if (_mc->_id_ex->_src1 != 0 && _mc->_gprReadyCycles[_mc->_id_ex->_src1] > 0) {
-               if (_mc->_gprForwardedReadyCycles[_mc->_id_ex->_src1] == 0) { // take from EX-MEM register
-                  _mc->_id_ex->_forwardSrc1 = 1;
-               } else if (_mc->_gprForwardedReadyCycles[_mc->_id_ex->_src1] == 1) { // take from MEM-MEM register
-                  _mc->_id_ex->_forwardSrc1 = 2;
-               } else {
-#ifdef MIPC_DEBUG
-                  fprintf(_mc->_debugLog, "<%llu> stall because forward %d not available\n", SIM_TIME, _mc->_id_ex->_src1);
-#endif
-                  valid = 0;
+            if (!P::Forward::bypass) {
+               valid = 0;	// no bypass network, wait for write-back
+            } else {
+               if (_mc->_id_ex->_src1 != 0 && _mc->_gprReadyCycles[_mc->_id_ex->_src1] > 0) {
+                  if (_mc->_gprForwardedReadyCycles[_mc->_id_ex->_src1] == 0) { // take from EX-MEM register
+                     _mc->_id_ex->_forwardSrc1 = 1;
+                  } else if (_mc->_gprForwardedReadyCycles[_mc->_id_ex->_src1] == 1) { // take from MEM-MEM register
+                     _mc->_id_ex->_forwardSrc1 = 2;
+                  } else {
+                     MIPC_TRACE(P, _mc, "<%llu> stall because forward %d not available\n", SIM_TIME, _mc->_id_ex->_src1);
+                     valid = 0;
+                  }
                }
-            }
-            if (_mc->_id_ex->_src2 != 0 && _mc->_gprReadyCycles[_mc->_id_ex->_src2] > 0) {
-               if (_mc->_gprForwardedReadyCycles[_mc->_id_ex->_src2] == 0) { // take from EX-MEM register
-                  _mc->_id_ex->_forwardSrc2 = 1;
-               } else if (_mc->_gprForwardedReadyCycles[_mc->_id_ex->_src2] == 1) { // take from MEM-MEM register
-                  _mc->_id_ex->_forwardSrc2 = 2;
-               } else {
-#ifdef MIPC_DEBUG
-                  fprintf(_mc->_debugLog, "<%llu> stall because forward %d not available\n", SIM_TIME, _mc->_id_ex->_src2);
-#endif
-                  valid = 0;
+               if (_mc->_id_ex->_src2 != 0 && _mc->_gprReadyCycles[_mc->_id_ex->_src2] > 0) {
+                  if (_mc->_gprForwardedReadyCycles[_mc->_id_ex->_src2] == 0) { // take from EX-MEM register
+                     _mc->_id_ex->_forwardSrc2 = 1;
+                  } else if (_mc->_gprForwardedReadyCycles[_mc->_id_ex->_src2] == 1) { // take from MEM-MEM register
+                     _mc->_id_ex->_forwardSrc2 = 2;
+                  } else {
+                     MIPC_TRACE(P, _mc, "<%llu> stall because forward %d not available\n", SIM_TIME, _mc->_id_ex->_src2);
+                     valid = 0;
+                  }
                }
-            }
-            if (_mc->_id_ex->_src3 != 0 && _mc->_gprReadyCycles[_mc->_id_ex->_src3] > 0) {
-               if (_mc->_gprForwardedReadyCycles[_mc->_id_ex->_src3] <= 1) { // take from MEM-WB register
-                  _mc->_id_ex->_forwardSrc3 = 2;
-               } else {
-#ifdef MIPC_DEBUG
-                  fprintf(_mc->_debugLog, "<%llu> stall because forward %d not available\n", SIM_TIME, _mc->_id_ex->_src3);
-#endif
-                  valid = 0;
+               if (_mc->_id_ex->_src3 != 0 && _mc->_gprReadyCycles[_mc->_id_ex->_src3] > 0) {
+                  if (_mc->_gprForwardedReadyCycles[_mc->_id_ex->_src3] <= 1) { // take from MEM-WB register
+                     _mc->_id_ex->_forwardSrc3 = 2;
+                  } else {
+                     MIPC_TRACE(P, _mc, "<%llu> stall because forward %d not available\n", SIM_TIME, _mc->_id_ex->_src3);
+                     valid = 0;
+                  }
                }
             }
             if (valid) {
-#ifdef MIPC_DEBUG
-               fprintf(_mc->_debugLog, "<%llu> Using forwarded values: src1 (%d) and src2 (%d) src3 (%d)\n", SIM_TIME, _mc->_id_ex->_forwardSrc1, _mc->_id_ex->_forwardSrc2, _mc->_id_ex->_forwardSrc3);
-#endif               
+               MIPC_TRACE(P, _mc, "<%llu> Using forwarded values: src1 (%d) and src2 (%d) src3 (%d)\n", SIM_TIME, _mc->_id_ex->_forwardSrc1, _mc->_id_ex->_forwardSrc2, _mc->_id_ex->_forwardSrc3);
                goto legal_op;   
             }
-#ifdef MIPC_DEBUG
-         fprintf(_mc->_debugLog, "<%llu> Instruction %#x operands not ready, adding interlock src1 = %d src2 = %d ready1 = %d ready2 = %d\n", SIM_TIME, _mc->_id_ex->_ins, _mc->_id_ex->_src1, _mc->_id_ex->_src2, _mc->_gprReadyCycles[_mc->_id_ex->_src1], _mc->_gprReadyCycles[_mc->_id_ex->_src2]);
-#endif
+            MIPC_TRACE(P, _mc, "<%llu> Instruction %#x operands not ready, adding interlock src1 = %d src2 = %d ready1 = %d ready2 = %d\n", SIM_TIME, _mc->_id_ex->_ins, _mc->_id_ex->_src1, _mc->_id_ex->_src2, _mc->_gprReadyCycles[_mc->_id_ex->_src1], _mc->_gprReadyCycles[_mc->_id_ex->_src2]);
             _mc->_id_ex->_forwardSrc1 = 0;
             _mc->_id_ex->_forwardSrc2 = 0;
             _mc->_id_ex->_ins = 0;
             _mc->_id_ex->_bdslot = 0;
             _mc->_isInterlock = TRUE;
+            _mc->_num_interlocks++;
+            if (P::Stats::enabled) _mc->_profiler->Interlock (pc);
             _mc->_id_ex->Dec(_mc, _mc->_ex_mem, _mc->_mem_wb, _mc->_id_ex->_ins);
          } else if (!_mc->_id_ex->_isIllegalOp) {
 legal_op:
+            if (P::Stats::enabled) _mc->_profiler->Retire (pc, ins, SIM_TIME);
             if (_mc->_id_ex->_writeREG) {
                _mc->_gprReadyCycles[_mc->_id_ex->_decodedDST] = 3;
                _mc->_gprForwardedReadyCycles[_mc->_id_ex->_decodedDST] = ready_cycles;
-#ifdef MIPC_DEBUG
-         fprintf(_mc->_debugLog, "<%llu> Set forwarded ready cycles of %d to %d\n", SIM_TIME, _mc->_id_ex->_decodedDST, ready_cycles);
-#endif
+               MIPC_TRACE(P, _mc, "<%llu> Set forwarded ready cycles of %d to %d\n", SIM_TIME, _mc->_id_ex->_decodedDST, ready_cycles);
             }
             if (_mc->_id_ex->_writeFREG) {
                _mc->_fprReadyCycles[_mc->_id_ex->_decodedDST >> 1] = 3;
@@ -136,16 +131,22 @@ legal_op:
                _mc->_gprReadyCycles[HI] = 3;
                _mc->_gprForwardedReadyCycles[HI] = ready_cycles;
             }
-#ifdef MIPC_DEBUG
-         fprintf(_mc->_debugLog, "<%llu> Decoded instruction %#x correctly\n", SIM_TIME, _mc->_id_ex->_ins);
-#endif         
+            MIPC_TRACE(P, _mc, "<%llu> Decoded instruction %#x correctly\n", SIM_TIME, _mc->_id_ex->_ins);
          } else {
             // TODO
          }
       } else {
+         _mc->_num_stalls++;
+         if (P::Stats::enabled) _mc->_profiler->Stall (_mc->_id_ex->_pc);
          _mc->_id_ex->_ins = 0;
 
          _mc->_id_ex->Dec(_mc, _mc->_ex_mem, _mc->_mem_wb, _mc->_id_ex->_ins);
       }
    }
 }
+
+void
+Decode::MainLoop (void)
+{
+   MIPC_PIPELINE_DISPATCH (_mc, DecodeLoop, _mc);
+}
@@ -27,6 +27,7 @@ $name = $ARGV[$num];
 die ("usage: extract.pl [-num] <file_name>\n") unless (@ARGV < 3);
 @name_parts = split (/\./, $name);
 open (LIST, ">$name_parts[0].break");
+open (SYM, ">$name_parts[0].sym");
 
 @name_split = split (/\//, $name);
 $directory = $name;
@@ -85,6 +86,7 @@ load_data (0);
 close (INPUT);
 `rm -f $name_parts[0].out $name_parts[0].ld $name_parts[0].o`;
 close (LIST);
+close (SYM);
 close (OUTPUT);
 
 if ($num == 1) {
@@ -113,6 +115,8 @@ sub load_data {
 	$temp[1] =~ s/\://;
 	$data = $temp[1];
 	$addr = $temp[0];
+	($sym = $data) =~ s/[<>]//g;
+	print SYM "$addr $sym\n";   # symbol table for the Ksim profiler
 	if ($count == 0) {
 	  for ($i=0; $i<8; $i++) {
 	    $value += get_value(substr($addr,$i,1)) * (pow(7-$i));
@@ -0,0 +1,121 @@
+#include "mips.h"
+
+/*------------------------------------------------------------------------
+ *
+ *  Mipc::FunctionalStep --
+ *
+ *   Executes the instruction at _pc to completion with no timing: decode,
+ *   execute, memory access and write-back back to back, through the same
+ *   operation tables the pipeline stages use. A taken branch redirects
+ *   the PC after its delay slot, as in the pipeline.
+ *
+ *------------------------------------------------------------------------
+ */
+void
+Mipc::FunctionalStep (void)
+{
+   unsigned int pc = _pc;
+   unsigned int ins = _mem->BEGetWord (pc, _mem->Read (pc & ~(LL)0x7));
+   ID_EX_Register id;
+   MEM_WB_Register wb;
+   EX_MEM_Register *ex = _ex_mem;	// keeps the instruction counts
+   unsigned int next;
+
+   id._ins = ins;
+   id._pc = pc;
+   id.Dec (this, _ex_mem, _mem_wb, ins);	// nothing in flight, operands come from _gpr
+   _nfetched++;
+
+   ex->_ins = ins;
+   ex->_pc = pc;
+   ex->_decodedSRC1 = id._decodedSRC1;
+   ex->_decodedSRC2 = id._decodedSRC2;
+   ex->_decodedSRC3 = id._decodedSRC3;
+   ex->_decodedDST = id._decodedDST;
+   ex->_subregOperand = id._subregOperand;
+   ex->_memory_addr_reg = id._memory_addr_reg;
+   ex->_opResultHi = id._opResultHi;
+   ex->_opResultLo = id._opResultLo;
+   ex->_memControl = id._memControl;
+   ex->_writeREG = id._writeREG;
+   ex->_writeFREG = id._writeFREG;
+   ex->_branchOffset = id._branchOffset;
+   ex->_hiWPort = id._hiWPort;
+   ex->_loWPort = id._loWPort;
+   ex->_decodedShiftAmt = id._decodedShiftAmt;
+   ex->_bdslot = id._bdslot;
+   ex->_btgt = id._btgt;
+   ex->_btaken = 0;
+   ex->_isSyscall = id._isSyscall;
+   ex->_isIllegalOp = id._isIllegalOp;
+   ex->_src3 = id._src3;
+   ex->_forwardSrc3 = 0;
+   ex->_carryForward = 0;
+   ex->_opControl = id._opControl;
+   ex->_memOp = id._memOp;
+   ex->_hi = _hi;
+   ex->_lo = _lo;
+   ex->_opControl (ex, ins);
+
+   next = _lastbdslot ? _btgt : pc + 4;
+   _lastbdslot = 0;
+   if (ex->_btaken) {
+      _btgt = ex->_btgt;
+      _lastbdslot = 1;
+   }
+   _pc = next;
+
+   wb._ins = ins;
+   wb._pc = pc;
+   wb._decodedSRC1 = ex->_decodedSRC1;
+   wb._decodedSRC2 = ex->_decodedSRC2;
+   wb._decodedSRC3 = ex->_decodedSRC3;
+   wb._decodedDST = ex->_decodedDST;
+   wb._subregOperand = ex->_subregOperand;
+   wb._memory_addr_reg = ex->_memory_addr_reg;
+   wb._opResultHi = ex->_opResultHi;
+   wb._opResultLo = ex->_opResultLo;
+   wb._memControl = ex->_memControl;
+   wb._writeREG = ex->_writeREG;
+   wb._writeFREG = ex->_writeFREG;
+   wb._hiWPort = ex->_hiWPort;
+   wb._loWPort = ex->_loWPort;
+   wb._hi = ex->_hi;
+   wb._lo = ex->_lo;
+   wb._memOp = ex->_memOp;
+   if (wb._memControl) {
+      wb._memOp (this, &wb);
+   }
+
+   if (wb._writeREG) {
+      _gpr[wb._decodedDST] = wb._opResultLo;
+   }
+   else if (wb._writeFREG) {
+      _fpr[wb._decodedDST >> 1].l[FP_TWIDDLE ^ (wb._decodedDST & 1)] = wb._opResultLo;
+   }
+   if (wb._loWPort) _lo = wb._opResultLo;
+   if (wb._hiWPort) _hi = wb._opResultHi;
+   _gpr[0] = 0;
+
+   if (ex->_isSyscall) {
+      fake_syscall (ins);
+   }
+}
+
+/*------------------------------------------------------------------------
+ *
+ *  Mipc::FastForward --
+ *
+ *   Functional execution until `until' instructions have run or the
+ *   program exits. It never stops between a taken branch and its delay
+ *   slot, so the pipeline can take over from _pc alone.
+ *
+ *------------------------------------------------------------------------
+ */
+void
+Mipc::FastForward (LL until)
+{
+   while (!_sim_exit && (_nfetched < until || _lastbdslot)) {
+      FunctionalStep ();
+   }
+}
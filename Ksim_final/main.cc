@@ -38,6 +38,19 @@ int main (int argc, char **argv)
   RegisterDefault ("MemSystem.Type", "None");
   RegisterDefault ("Log.StartDumpTime", 0);
   RegisterDefault ("Mipc.PeriodicTimer", 100000);
+  RegisterDefault ("Mipc.Pipeline", "diagnostic");
+  RegisterDefault ("Mipc.Forwarding", "bypass");
+  RegisterDefault ("Mipc.Sample.Enable", 0);
+  RegisterDefault ("Mipc.Sample.Period", 1000000);
+  RegisterDefault ("Mipc.Sample.Warmup", 2000);
+  RegisterDefault ("Mipc.Sample.Interval", 10000);
+  RegisterDefault ("Mipc.Sample.Mode", "detailed");
+  RegisterDefault ("Mipc.Sample.Jobs", 0);
+  RegisterDefault ("Mipc.Profile.Enable", 1);
+  RegisterDefault ("Mipc.Profile.File", "mipc.prof");
+  RegisterDefault ("Mipc.Profile.SymbolFile", "");
+  RegisterDefault ("Mipc.Profile.TextBase", (int)0x00400000);
+  RegisterDefault ("Mipc.Profile.TextSize", 0x100000);
 
   /* fixup arguments */
   if (argc > 1) {
@@ -1,4 +1,5 @@
 #include "memory.h"
+#include "pipeline.h"
 
 Memory::Memory (Mipc *mc)
 {
@@ -7,8 +8,9 @@ Memory::Memory (Mipc *mc)
 
 Memory::~Memory (void) {}
 
-void
-Memory::MainLoop (void)
+template <class P>
+static void
+MemoryLoop (Mipc *_mc)
 {
    while (1) {
       AWAIT_P_PHI0;
@@ -48,28 +50,26 @@ Memory::MainLoop (void)
          if (_mc->_ex_mem->_src3 < 32) temp._decodedSRC3 = _mc->_mem_wb->_gprForward[_mc->_ex_mem->_src3];
          else if (_mc->_ex_mem->_src3 == HI) temp._hi = _mc->_mem_wb->_gprForward[HI];
          else if (_mc->_ex_mem->_src3 == LO) temp._lo = _mc->_mem_wb->_gprForward[LO];
-#ifdef MIPC_DEBUG
-         fprintf(_mc->_debugLog, "<%llu> Use forwarded value of %#x for register %d from MEM-WB\n", SIM_TIME, temp._decodedSRC3, _mc->_ex_mem->_src3);
-#endif
+         MIPC_TRACE(P, _mc, "<%llu> Use forwarded value of %#x for register %d from MEM-WB\n", SIM_TIME, temp._decodedSRC3, _mc->_ex_mem->_src3);
       }
 
       AWAIT_P_PHI1;
       *(_mc->_mem_wb) = temp;
       if (_mc->_mem_wb->_memControl) {
          _mc->_mem_wb->_memOp(_mc, _mc->_mem_wb);
-#ifdef MIPC_DEBUG
-         fprintf(_mc->_debugLog, "<%llu> Memory involved in ins %#x, using address %#x\n", SIM_TIME, _mc->_mem_wb->_ins, _mc->_mem_wb->_memory_addr_reg);
-#endif
+         MIPC_TRACE(P, _mc, "<%llu> Memory involved in ins %#x, using address %#x\n", SIM_TIME, _mc->_mem_wb->_ins, _mc->_mem_wb->_memory_addr_reg);
          if (_mc->_mem_wb->_writeREG) {
             _mc->_mem_wb->_gprForward[_mc->_mem_wb->_decodedDST] = _mc->_mem_wb->_opResultLo;
-#ifdef MIPC_DEBUG
-            fprintf(_mc->_debugLog, "<%llu> Write to MEM-WB register %d value %#x\n", SIM_TIME, _mc->_mem_wb->_decodedDST, _mc->_mem_wb->_opResultLo);
-#endif
+            MIPC_TRACE(P, _mc, "<%llu> Write to MEM-WB register %d value %#x\n", SIM_TIME, _mc->_mem_wb->_decodedDST, _mc->_mem_wb->_opResultLo);
          }
       } else {
-#ifdef MIPC_DEBUG
-         fprintf(_mc->_debugLog, "<%llu> No memory involved in ins %#x, pc = %#x\n", SIM_TIME, _mc->_ex_mem->_ins, _mc->_ex_mem->_pc);
-#endif         
+         MIPC_TRACE(P, _mc, "<%llu> No memory involved in ins %#x, pc = %#x\n", SIM_TIME, _mc->_ex_mem->_ins, _mc->_ex_mem->_pc);
       }
    }
 }
+
+void
+Memory::MainLoop (void)
+{
+   MIPC_PIPELINE_DISPATCH (_mc, MemoryLoop, _mc);
+}
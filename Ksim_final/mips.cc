@@ -1,11 +1,42 @@
 #include "mips.h"
+#include "sampler.h"
+#include "profiler.h"
+#include "perfctr.h"
+#include "pipeline.h"
 #include <assert.h>
+#include <string.h>
 #include "mips-irix5.h"
 
 Mipc::Mipc (Mem *m) : _l('M')
 {
    _mem = m;
    _sys = new MipcSysCall (this);	// Allocate syscall layer
+   _sampler = new MipcSampler ();
+   _profiler = new MipcProfiler ();
+   _perf = new MipcPerfCounters (this);
+
+   // Pick the pipeline instantiation; see pipeline.h
+   _pipeline = strcmp (ParamGetString ("Mipc.Pipeline"), "fast") ? MIPC_PIPE_DIAG : MIPC_PIPE_FAST;
+   if (!strcmp (ParamGetString ("Mipc.Forwarding"), "none")) {
+      _pipeline = (_pipeline == MIPC_PIPE_FAST) ? MIPC_PIPE_FAST_NOBYPASS : MIPC_PIPE_DIAG_NOBYPASS;
+   }
+   if (_pipeline == MIPC_PIPE_FAST || _pipeline == MIPC_PIPE_FAST_NOBYPASS) {
+      // Nothing feeds them in the fast pipeline, except the forked units
+      // of functional sampling
+      if (_sampler->_enabled && !_sampler->_functional) {
+         fprintf (stderr, "Warning: Mipc.Sample.Enable is ignored with Mipc.Pipeline=fast\n");
+         _sampler->_enabled = FALSE;
+      }
+      if (_profiler->_enabled) {
+         fprintf (stderr, "Warning: Mipc.Profile.Enable is ignored with Mipc.Pipeline=fast\n");
+      }
+      _profiler->_enabled = FALSE;
+   }
+   if (_sampler->_functional && _profiler->_enabled) {
+      // The pipeline only sees the sampled units, in other processes
+      fprintf (stderr, "Warning: Mipc.Profile.Enable is ignored with Mipc.Sample.Mode=functional\n");
+      _profiler->_enabled = FALSE;
+   }
 
 #ifdef MIPC_DEBUG
    _debugLog = fopen("mipc.debug", "w");
@@ -20,34 +51,46 @@ Mipc::~Mipc (void)
 
 }
 
-void 
-Mipc::MainLoop (void)
+template <class P>
+static void
+FetchLoop (Mipc *mc)
 {
    LL addr;
    unsigned int ins;	// Local instruction register
 
-   Assert (_boot, "Mipc::MainLoop() called without boot?");
-
-   _nfetched = 0;
-
-   while (!_sim_exit) {
+   while (!mc->_sim_exit) {
       AWAIT_P_PHI0;
-      Bool stall = _isStall;
+      Bool stall = mc->_isStall;
 
       AWAIT_P_PHI1;
       if (!stall) {
-         addr = _pc;
-         ins = _mem->BEGetWord(addr, _mem->Read(addr & ~(LL)0x7));
-#ifdef MIPC_DEBUG
-         fprintf(_debugLog, "<%llu> Fetched instruction %#x at PC %#x\n", SIM_TIME, ins, addr);
-#endif
-         _if_id->_prevIns = _if_id->_ins;
-         _if_id->_prevPc = _if_id->_pc;
-         _if_id->_ins = ins;
-         _if_id->_pc = addr;
-         _pc = _pc + 4;
-         _nfetched++;
+         addr = mc->_pc;
+         ins = mc->_mem->BEGetWord(addr, mc->_mem->Read(addr & ~(LL)0x7));
+         MIPC_TRACE(P, mc, "<%llu> Fetched instruction %#x at PC %#x\n", SIM_TIME, ins, addr);
+         mc->_if_id->_prevIns = mc->_if_id->_ins;
+         mc->_if_id->_prevPc = mc->_if_id->_pc;
+         mc->_if_id->_ins = ins;
+         mc->_if_id->_pc = addr;
+         mc->_pc = mc->_pc + 4;
+         mc->_nfetched++;
       }
+      if (P::Stats::enabled || mc->_sampler->_child) mc->_sampler->Tick (mc->_nfetched, SIM_TIME);
+   }
+}
+
+void 
+Mipc::MainLoop (void)
+{
+   Assert (_boot, "Mipc::MainLoop() called without boot?");
+
+   _nfetched = 0;
+
+   if (_sampler->_functional) {
+      _sampler->RunFunctional (this);	// returns into the pipeline in the children
+   }
+   if (!_sampler->_functional || _sampler->_child) {
+      MIPC_PIPELINE_DISPATCH (this, FetchLoop, this);
+      if (_sampler->_child) _sampler->ChildExit ();
    }
 
    MipcDumpstats();
@@ -71,8 +114,10 @@ Mipc::MipcDumpstats()
   l.print ("************************************************************");
   l.print ("");
   l.print ("Number of instructions: %llu", _nfetched);
-  l.print ("Number of simulated cycles: %llu", SIM_TIME);
-  l.print ("CPI: %.2f", ((double)SIM_TIME)/_nfetched);
+  if (!_sampler->_functional) {
+     l.print ("Number of simulated cycles: %llu", SIM_TIME);
+     l.print ("CPI: %.2f", ((double)SIM_TIME)/_nfetched);
+  }
   l.print ("Int Conditional Branches: %llu", _ex_mem->_num_cond_br);
   l.print ("Jump and Link: %llu", _ex_mem->_num_jal);
   l.print ("Jump Register: %llu", _ex_mem->_num_jr);
@@ -81,13 +126,25 @@ Mipc::MipcDumpstats()
   l.print ("Number of syscall emulated loads: %llu", _sys->_num_load);
   l.print ("Number of stores: %llu", _ex_mem->_num_store);
   l.print ("Number of syscall emulated stores: %llu", _sys->_num_store);
+  if (!_sampler->_functional) {
+     l.print ("Interlock cycles: %llu", _num_interlocks);
+     l.print ("Syscall stall cycles: %llu", _num_stalls);
+  }
+  _sampler->Dumpstats (&l, _nfetched);
+  _perf->Dumpstats (&l);
   l.print ("");
 
+  _profiler->Dump ();
+
 }
 
 void 
 Mipc::fake_syscall (unsigned int ins)
 {
+   if (_gpr[2] == MIPC_SYS_PERFCTR) {	// Simulator-private, not IRIX
+      _perf->SysCall ();
+      return;
+   }
    _sys->pc = _pc;
    _sys->quit = 0;
    _sys->EmulateSysCall ();
@@ -130,6 +187,8 @@ Mipc::Reboot (char *image)
       _num_cond_br = 0;
       _num_jal = 0;
       _num_jr = 0;
+      _num_interlocks = 0;
+      _num_stalls = 0;
 
       _lastbdslot = 0;
       _bdslot = 0;
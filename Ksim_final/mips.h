@@ -5,6 +5,9 @@
 
 class Mipc;
 class MipcSysCall;
+class MipcSampler;
+class MipcProfiler;
+class MipcPerfCounters;
 class SysCall;
 
 typedef unsigned Bool;
@@ -27,6 +30,8 @@ typedef unsigned Bool;
 #include "../../common/syscall.h"
 #include "queue.h"
 
+// Compiles in the tracing hooks. Whether they run is decided at startup by
+// Mipc.Pipeline (see pipeline.h).
 #define MIPC_DEBUG 1
 
 class IF_ID_Register;
@@ -254,6 +259,9 @@ public:
    FAKE_SIM_TEMPLATE;
 
    MipcSysCall *_sys;		// Emulated system call layer
+   MipcSampler *_sampler;	// Sampled-simulation statistics
+   MipcProfiler *_profiler;	// Per-PC cycle and stall profile
+   MipcPerfCounters *_perf;	// Guest-visible performance counters
 
    void dumpregs (void);	// Dumps current register state
 
@@ -265,6 +273,9 @@ public:
    void MipcDumpstats();			// Prints simulation statistics
    void fake_syscall (unsigned int ins);	// System call interface
 
+   void FastForward (LL until);		// Functional execution, no timing
+   void FunctionalStep (void);		// One instruction of it
+
    /* processor state */
    unsigned int _ins;   // instruction register
 
@@ -295,6 +306,8 @@ public:
    Bool     _isStall;
    Bool     _isInterlock;
 
+   int      _pipeline;			// MIPC_PIPE_* policy instantiation
+
    // Simulation statistics counters
 
    LL	_nfetched;
@@ -304,6 +317,8 @@ public:
    LL   _num_load;
    LL   _num_store;
    LL   _fpinst;
+   LL   _num_interlocks;	// kept in every pipeline, unlike the profile
+   LL   _num_stalls;
 
    Mem	*_mem;	// attached memory (not a cache)
 
@@ -0,0 +1,154 @@
+#include "mips.h"
+#include "perfctr.h"
+#include <string.h>
+
+static const char *counterNames[MIPC_PERF_NCOUNTERS] = {
+   "cycles", "instructions", "loads", "stores",
+   "branches", "interlock cycles", "stall cycles", "cache misses"
+};
+
+MipcPerfCounters::MipcPerfCounters (Mipc *mc)
+{
+   _mc = mc;
+   _nregions = 0;
+}
+
+MipcPerfCounters::~MipcPerfCounters (void) {}
+
+void
+MipcPerfCounters::Read (LL *ctr)
+{
+   ctr[MIPC_PERF_CYCLES] = SIM_TIME;
+   ctr[MIPC_PERF_INSTS] = _mc->_nfetched;
+   ctr[MIPC_PERF_LOADS] = _mc->_ex_mem->_num_load;
+   ctr[MIPC_PERF_STORES] = _mc->_ex_mem->_num_store;
+   ctr[MIPC_PERF_BRANCHES] = _mc->_ex_mem->_num_cond_br;
+   ctr[MIPC_PERF_INTERLOCKS] = _mc->_num_interlocks;
+   ctr[MIPC_PERF_STALLS] = _mc->_num_stalls;
+   ctr[MIPC_PERF_CACHE_MISSES] = 0;
+}
+
+/*
+ * Region names live in guest memory; read them straight from Mem so the
+ * lookup does not show up in the syscall load statistics.
+ */
+int
+MipcPerfCounters::FindRegion (LL nameAddr, Bool create)
+{
+   char name[MIPC_PERF_MAX_NAME];
+   int i;
+
+   for (i = 0; i < MIPC_PERF_MAX_NAME - 1; i++) {
+      LL a = nameAddr + i;
+      Word w = _mc->_mem->BEGetWord (a & ~(LL)0x3, _mc->_mem->Read (a & ~(LL)0x7));
+      name[i] = (w >> (8*(3 - (a & 0x3)))) & 0xff;
+      if (name[i] == '\0') break;
+   }
+   name[i] = '\0';
+
+   for (i = 0; i < _nregions; i++) {
+      if (!strcmp (_regions[i]._name, name)) return i;
+   }
+   if (!create || _nregions == MIPC_PERF_MAX_REGIONS) return -1;
+
+   strcpy (_regions[_nregions]._name, name);
+   ResetRegion (_nregions);
+   return _nregions++;
+}
+
+void
+MipcPerfCounters::ResetRegion (int r)
+{
+   _regions[r]._active = FALSE;
+   _regions[r]._entries = 0;
+   for (int c = 0; c < MIPC_PERF_NCOUNTERS; c++) {
+      _regions[r]._start[c] = 0;
+      _regions[r]._total[c] = 0;
+   }
+}
+
+void
+MipcPerfCounters::SysCall (void)
+{
+   unsigned int op = _mc->_gpr[4];		// $a0
+   unsigned int arg = _mc->_gpr[5];		// $a1
+   LL ctr[MIPC_PERF_NCOUNTERS];
+   LL ret = 0;
+   Bool err = FALSE;
+   int r;
+
+   Read (ctr);
+
+   switch (op) {
+   case MIPC_PERF_READ:
+      if (arg < MIPC_PERF_NCOUNTERS) ret = ctr[arg];
+      else err = TRUE;
+      break;
+
+   case MIPC_PERF_REGION_START:
+      r = FindRegion (arg, TRUE);
+      if (r < 0 || _regions[r]._active) {
+         err = TRUE;
+         break;
+      }
+      _regions[r]._active = TRUE;
+      for (int c = 0; c < MIPC_PERF_NCOUNTERS; c++) _regions[r]._start[c] = ctr[c];
+      ret = r;
+      break;
+
+   case MIPC_PERF_REGION_STOP:
+      r = FindRegion (arg, FALSE);
+      if (r < 0 || !_regions[r]._active) {
+         err = TRUE;
+         break;
+      }
+      _regions[r]._active = FALSE;
+      _regions[r]._entries++;
+      for (int c = 0; c < MIPC_PERF_NCOUNTERS; c++) {
+         _regions[r]._total[c] += ctr[c] - _regions[r]._start[c];
+      }
+      ret = r;
+      break;
+
+   case MIPC_PERF_RESET:
+      if (arg == 0) {
+         for (r = 0; r < _nregions; r++) ResetRegion (r);
+      }
+      else if ((r = FindRegion (arg, FALSE)) >= 0) {
+         ResetRegion (r);
+      }
+      else {
+         err = TRUE;
+      }
+      break;
+
+   default:
+      err = TRUE;
+      break;
+   }
+
+#ifdef MIPC_DEBUG
+   fprintf(_mc->_debugLog, "<%llu> perfctr op %u arg %#x -> %llu%s\n", SIM_TIME, op, arg, ret, err ? " (error)" : "");
+#endif
+
+   _mc->_gpr[2] = (unsigned int)ret;		// $v0
+   _mc->_gpr[3] = (unsigned int)(ret >> 32);	// $v1
+   _mc->_gpr[7] = err ? 1 : 0;			// $a3
+}
+
+void
+MipcPerfCounters::Dumpstats (Log *l)
+{
+   for (int r = 0; r < _nregions; r++) {
+      Region *reg = &_regions[r];
+
+      l->print ("Region \"%s\": %llu entries%s", reg->_name, reg->_entries,
+                reg->_active ? " (still active)" : "");
+      for (int c = 0; c < MIPC_PERF_NCOUNTERS; c++) {
+         l->print ("  %s: %llu", counterNames[c], reg->_total[c]);
+      }
+      if (reg->_total[MIPC_PERF_INSTS]) {
+         l->print ("  CPI: %.2f", ((double)reg->_total[MIPC_PERF_CYCLES])/reg->_total[MIPC_PERF_INSTS]);
+      }
+   }
+}
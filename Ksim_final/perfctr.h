@@ -0,0 +1,72 @@
+#ifndef __PERFCTR_H__
+#define __PERFCTR_H__
+
+// Guest-visible performance counters.
+//
+// A benchmark running under Ksim reads the simulated counters and brackets
+// regions of interest through one extra system call:
+//
+//    syscall (MIPC_SYS_PERFCTR, MIPC_PERF_READ, MIPC_PERF_CYCLES);
+//    syscall (MIPC_SYS_PERFCTR, MIPC_PERF_REGION_START, "inner loop");
+//    ...
+//    syscall (MIPC_SYS_PERFCTR, MIPC_PERF_REGION_STOP, "inner loop");
+//
+// READ returns the low word of the counter in $v0 and the high word in $v1.
+// REGION_START returns the region number. RESET takes a region name, or 0
+// to reset every region. Errors set $a3 like any other emulated syscall.
+// Per-region totals are printed by MipcDumpstats.
+//
+// The constants below are plain #defines so this header can be included
+// from guest programs as well.
+
+#define MIPC_SYS_PERFCTR	2000
+
+#define MIPC_PERF_READ		0
+#define MIPC_PERF_REGION_START	1
+#define MIPC_PERF_REGION_STOP	2
+#define MIPC_PERF_RESET		3
+
+#define MIPC_PERF_CYCLES	0
+#define MIPC_PERF_INSTS		1
+#define MIPC_PERF_LOADS		2
+#define MIPC_PERF_STORES	3
+#define MIPC_PERF_BRANCHES	4
+#define MIPC_PERF_INTERLOCKS	5
+#define MIPC_PERF_STALLS	6
+#define MIPC_PERF_CACHE_MISSES	7	// 0 until a cache is modeled
+#define MIPC_PERF_NCOUNTERS	8
+
+#ifdef __MIPS_H__
+
+#define MIPC_PERF_MAX_REGIONS	32
+#define MIPC_PERF_MAX_NAME	64
+
+class MipcPerfCounters {
+public:
+   MipcPerfCounters (Mipc *mc);
+   ~MipcPerfCounters ();
+
+   void SysCall (void);			// Services MIPC_SYS_PERFCTR
+   void Dumpstats (Log *l);		// Prints per-region results
+
+private:
+   void Read (LL *ctr);			// Snapshot of all counters
+   int  FindRegion (LL nameAddr, Bool create);
+   void ResetRegion (int r);
+
+   struct Region {
+      char _name[MIPC_PERF_MAX_NAME];
+      Bool _active;
+      LL _entries;			// Completed start/stop pairs
+      LL _start[MIPC_PERF_NCOUNTERS];
+      LL _total[MIPC_PERF_NCOUNTERS];
+   };
+
+   Mipc *_mc;
+   int _nregions;
+   Region _regions[MIPC_PERF_MAX_REGIONS];
+};
+
+#endif /* __MIPS_H__ */
+
+#endif /* __PERFCTR_H__ */
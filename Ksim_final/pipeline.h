@@ -0,0 +1,68 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include "mips.h"
+
+// Compile-time pipeline policies.
+//
+// Each stage loop is a function template over a MipcPipeline<> bundle.
+// Policy members are compile-time constants, so a disabled policy folds
+// away entirely and the "fast" instantiation carries no tracing or
+// profiling code at all. Mipc.Pipeline and Mipc.Forwarding pick the
+// instantiation once at startup; see MIPC_PIPELINE_DISPATCH.
+//
+// Only fetch, decode and memory are parameterized so far. Exe and Writeback
+// (executor.cc, wb.cc) and the EX_MEM_Register op functions that update
+// _num_load, _num_store and the branch counts are not templated and run
+// the same code in every instantiation. How much faster the fast pipeline
+// is per simulated instruction has not been measured; bench/run.pl can
+// compare the two.
+
+// Tracing to mipc.debug
+struct MipcTraceOn  { static const bool enabled = true; };
+struct MipcTraceOff { static const bool enabled = false; };
+
+// Per-PC profiling, sampling and derived counters
+struct MipcStatsFull { static const bool enabled = true; };
+struct MipcStatsNone { static const bool enabled = false; };
+
+// Forwarding model: full EX/MEM bypass, or interlock until write-back
+struct MipcForwardBypass { static const bool bypass = true; };
+struct MipcForwardNone   { static const bool bypass = false; };
+
+template <class T, class S, class F>
+struct MipcPipeline {
+   typedef T Trace;
+   typedef S Stats;
+   typedef F Forward;
+};
+
+typedef MipcPipeline<MipcTraceOn,  MipcStatsFull, MipcForwardBypass> MipcDiagPipeline;
+typedef MipcPipeline<MipcTraceOff, MipcStatsNone, MipcForwardBypass> MipcFastPipeline;
+typedef MipcPipeline<MipcTraceOn,  MipcStatsFull, MipcForwardNone>   MipcDiagNoBypassPipeline;
+typedef MipcPipeline<MipcTraceOff, MipcStatsNone, MipcForwardNone>   MipcFastNoBypassPipeline;
+
+// Values of Mipc::_pipeline
+#define MIPC_PIPE_DIAG			0
+#define MIPC_PIPE_FAST			1
+#define MIPC_PIPE_DIAG_NOBYPASS		2
+#define MIPC_PIPE_FAST_NOBYPASS		3
+
+#define MIPC_PIPELINE_DISPATCH(mc, fn, arg)				\
+   switch ((mc)->_pipeline) {						\
+   case MIPC_PIPE_FAST: fn<MipcFastPipeline> (arg); break;		\
+   case MIPC_PIPE_DIAG_NOBYPASS: fn<MipcDiagNoBypassPipeline> (arg); break; \
+   case MIPC_PIPE_FAST_NOBYPASS: fn<MipcFastNoBypassPipeline> (arg); break; \
+   default: fn<MipcDiagPipeline> (arg); break;			\
+   }
+
+#ifdef MIPC_DEBUG
+#define MIPC_TRACE(P, mc, ...)						\
+   do {									\
+      if (P::Trace::enabled) fprintf ((mc)->_debugLog, __VA_ARGS__);	\
+   } while (0)
+#else
+#define MIPC_TRACE(P, mc, ...) do { } while (0)
+#endif
+
+#endif /* __PIPELINE_H__ */
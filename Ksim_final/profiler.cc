@@ -0,0 +1,231 @@
+#include "profiler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#define PROFILE_TEXT_SLACK 0x10000	// Bytes profiled past the last symbol
+#define PROFILE_TOP_PCS 50
+
+MipcProfiler::MipcProfiler (void)
+{
+   char *symfile;
+   char buf[1024];
+
+   _enabled = ParamGetInt ("Mipc.Profile.Enable") ? TRUE : FALSE;
+   memset (&_outside, 0, sizeof (_outside));
+   _callSite = 0;
+   _callCountdown = 0;
+   _pendingReturn = FALSE;
+   _base = 0;
+   _nwords = 0;
+   _counters = NULL;
+
+   if (!_enabled) return;
+
+   // Default symbol file is <program>.sym next to <program>.image
+   symfile = ParamGetString ("Mipc.Profile.SymbolFile");
+   if (!symfile || !symfile[0]) {
+      char *ext;
+      strncpy (buf, ParamGetString ("Mipc.BootROM"), sizeof (buf) - 8);
+      buf[sizeof (buf) - 8] = '\0';
+      ext = strrchr (buf, '.');
+      if (ext && !strcmp (ext, ".image")) *ext = '\0';
+      strcat (buf, ".sym");
+      symfile = buf;
+   }
+   ReadSymbols (symfile);
+
+   if (_syms.size () > 0) {
+      _base = _syms[0]._addr;
+      _nwords = (_syms.back()._addr + PROFILE_TEXT_SLACK - _base) >> 2;
+   }
+   else {
+      _base = ParamGetInt ("Mipc.Profile.TextBase");
+      _nwords = ParamGetInt ("Mipc.Profile.TextSize") >> 2;
+   }
+   _counters = (PcCounters *) calloc (_nwords, sizeof (PcCounters));
+   if (!_counters) {
+      fatal_error ("Could not allocate profile counters for %u words", _nwords);
+   }
+}
+
+MipcProfiler::~MipcProfiler (void)
+{
+   for (unsigned int i = 0; i < _syms.size (); i++) free (_syms[i]._name);
+   free (_counters);
+}
+
+static bool
+CyclesGreater (const MipcProfiler::PcCounters *a, const MipcProfiler::PcCounters *b)
+{
+   return a->_cycles > b->_cycles;
+}
+
+static bool
+AddrLess (const MipcProfiler::Symbol &a, const MipcProfiler::Symbol &b)
+{
+   return a._addr < b._addr;
+}
+
+void
+MipcProfiler::ReadSymbols (const char *fname)
+{
+   FILE *fp;
+   char line[1024], name[1024];
+   unsigned int addr;
+
+   fp = fopen (fname, "r");
+   if (!fp) {
+      printf ("Profiler: no symbol file `%s', reporting raw PCs\n", fname);
+      return;
+   }
+   while (fgets (line, sizeof (line), fp)) {
+      if (sscanf (line, "%x %1023s", &addr, name) == 2) {
+         Symbol s;
+         s._addr = addr;
+         s._name = strdup (name);
+         _syms.push_back (s);
+      }
+   }
+   fclose (fp);
+
+   std::sort (_syms.begin (), _syms.end (), AddrLess);
+}
+
+int
+MipcProfiler::FindSymbol (unsigned int pc)
+{
+   int lo = 0, hi = (int)_syms.size () - 1, found = -1;
+
+   while (lo <= hi) {
+      int mid = (lo + hi) / 2;
+      if (_syms[mid]._addr <= pc) {
+         found = mid;
+         lo = mid + 1;
+      }
+      else {
+         hi = mid - 1;
+      }
+   }
+   return found;
+}
+
+void
+MipcProfiler::Control (unsigned int pc, unsigned int ins, LL cycle)
+{
+   if (_callCountdown && --_callCountdown == 0) {
+      if (_pendingReturn) {
+         if (!_stack.empty ()) {
+            Frame f = _stack.back ();
+            _stack.pop_back ();
+            _inclusive[f._func] += cycle - f._start;
+         }
+      }
+      else {
+         int callee = FindSymbol (pc);
+         _edges[std::make_pair (FindSymbol (_callSite), callee)]++;
+         Frame f;
+         f._func = callee;
+         f._start = cycle;
+         _stack.push_back (f);
+      }
+   }
+
+   if (IsCallOrReturn (ins)) {
+      unsigned int op = ins >> 26;
+      unsigned int funct = ins & 0x3f;
+      unsigned int rs = (ins >> 21) & 0x1f;
+
+      if (op == 3 || funct == 9) {		// jal, jalr
+         _callSite = pc;
+         _callCountdown = 2;
+         _pendingReturn = FALSE;
+      }
+      else if (rs == 31) {			// jr $ra
+         _callCountdown = 2;
+         _pendingReturn = TRUE;
+      }
+   }
+}
+
+void
+MipcProfiler::Dump (void)
+{
+   FILE *fp;
+   char *fname;
+   int nfuncs = _syms.size () + 1;		// last slot is "unknown"
+   std::vector<PcCounters> funcs (nfuncs);
+   std::vector<PcCounters *> order;
+   std::vector<PcCounters *> pcs;
+   PcCounters total;
+
+   if (!_enabled) return;
+
+   fname = ParamGetString ("Mipc.Profile.File");
+   fp = fopen (fname, "w");
+   if (!fp) {
+      printf ("Profiler: could not open `%s' for writing\n", fname);
+      return;
+   }
+
+   memset (&total, 0, sizeof (total));
+   for (unsigned int i = 0; i < _nwords; i++) {
+      PcCounters *c = &_counters[i];
+      if (!c->_cycles) continue;
+      int f = FindSymbol (_base + (i << 2));
+      PcCounters *d = &funcs[f < 0 ? nfuncs - 1 : f];
+      d->_insts += c->_insts;
+      d->_cycles += c->_cycles;
+      d->_interlocks += c->_interlocks;
+      d->_stalls += c->_stalls;
+      pcs.push_back (c);
+   }
+   for (int f = 0; f < nfuncs; f++) {
+      total._insts += funcs[f]._insts;
+      total._cycles += funcs[f]._cycles;
+      if (funcs[f]._cycles) order.push_back (&funcs[f]);
+   }
+   total._insts += _outside._insts;
+   total._cycles += _outside._cycles;
+
+   std::sort (order.begin (), order.end (), CyclesGreater);
+   std::sort (pcs.begin (), pcs.end (), CyclesGreater);
+
+   fprintf (fp, "Flat profile: %llu cycles, %llu instructions", total._cycles, total._insts);
+   fprintf (fp, " (%llu cycles outside the profiled text)\n\n", _outside._cycles);
+   fprintf (fp, "%8s %12s %12s %6s %12s %12s  %s\n",
+            "%cycles", "cycles", "insts", "CPI", "interlocks", "stalls", "function");
+   for (unsigned int i = 0; i < order.size (); i++) {
+      PcCounters *d = order[i];
+      int f = d - &funcs[0];
+      fprintf (fp, "%8.2f %12llu %12llu %6.2f %12llu %12llu  %s\n",
+               total._cycles ? 100.0*d->_cycles/total._cycles : 0.0,
+               d->_cycles, d->_insts, d->_insts ? (double)d->_cycles/d->_insts : 0.0,
+               d->_interlocks, d->_stalls,
+               f < nfuncs - 1 ? _syms[f]._name : "<unknown>");
+   }
+
+   fprintf (fp, "\nHot PCs:\n");
+   fprintf (fp, "%10s %12s %12s %12s %12s  %s\n",
+            "pc", "cycles", "insts", "interlocks", "stalls", "function");
+   for (unsigned int i = 0; i < pcs.size () && i < PROFILE_TOP_PCS; i++) {
+      PcCounters *c = pcs[i];
+      unsigned int pc = _base + ((c - _counters) << 2);
+      int f = FindSymbol (pc);
+      fprintf (fp, "%#10x %12llu %12llu %12llu %12llu  %s\n",
+               pc, c->_cycles, c->_insts, c->_interlocks, c->_stalls,
+               f >= 0 ? _syms[f]._name : "<unknown>");
+   }
+
+   fprintf (fp, "\nCall graph (caller -> callee):\n");
+   fprintf (fp, "%12s %16s  %s\n", "calls", "callee incl.", "edge");
+   for (std::map<std::pair<int,int>, LL>::iterator it = _edges.begin (); it != _edges.end (); it++) {
+      int caller = it->first.first;
+      int callee = it->first.second;
+      fprintf (fp, "%12llu %16llu  %s -> %s\n", it->second, _inclusive[callee],
+               caller >= 0 ? _syms[caller]._name : "<unknown>",
+               callee >= 0 ? _syms[callee]._name : "<unknown>");
+   }
+
+   fclose (fp);
+}
@@ -0,0 +1,96 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "mips.h"
+#include <map>
+#include <vector>
+
+// Guest-level profiler.
+//
+// Every cycle is charged to the PC sitting in the decode stage: a cycle in
+// which the instruction is accepted retires it, a cycle in which it waits on
+// an operand is an interlock, and a cycle spent draining the pipe for a
+// syscall is a stall. Counters live in a dense array indexed by word offset
+// from the start of the text segment, so the per-cycle cost is one subtract,
+// one compare and a couple of increments.
+//
+// At the end of the run the counters are folded into functions using the
+// symbol file written by extract.pl (<program>.sym) and a flat profile plus
+// a jal/jalr -> jr $ra call graph is written to Mipc.Profile.File.
+
+class MipcProfiler {
+public:
+   MipcProfiler ();
+   ~MipcProfiler ();
+
+   struct PcCounters {
+      LL _insts;			// Retired instructions
+      LL _cycles;			// Cycles spent in decode
+      LL _interlocks;			// Operand interlock cycles
+      LL _stalls;			// Pipeline drain (syscall) cycles
+   };
+
+   inline PcCounters *At (unsigned int pc) {
+      unsigned int off = (pc - _base) >> 2;
+      return (off < _nwords) ? &_counters[off] : &_outside;
+   }
+
+   inline void Retire (unsigned int pc, unsigned int ins, LL cycle) {
+      PcCounters *c = At (pc);
+      c->_insts++;
+      c->_cycles++;
+      if (_callCountdown || IsCallOrReturn (ins)) Control (pc, ins, cycle);
+   }
+   inline void Interlock (unsigned int pc) {
+      PcCounters *c = At (pc);
+      c->_interlocks++;
+      c->_cycles++;
+   }
+   inline void Stall (unsigned int pc) {
+      PcCounters *c = At (pc);
+      c->_stalls++;
+      c->_cycles++;
+   }
+
+   struct Symbol {
+      unsigned int _addr;
+      char *_name;
+   };
+
+   void Dump (void);			// Writes the profile file
+
+   Bool _enabled;
+
+private:
+   static inline Bool IsCallOrReturn (unsigned int ins) {
+      unsigned int op = ins >> 26;
+      unsigned int funct = ins & 0x3f;
+      return (op == 3) || (op == 0 && (funct == 8 || funct == 9));
+   }
+
+   void Control (unsigned int pc, unsigned int ins, LL cycle);
+   void ReadSymbols (const char *fname);
+   int  FindSymbol (unsigned int pc);
+
+   unsigned int _base;			// Address of first profiled word
+   unsigned int _nwords;		// Number of profiled words
+   PcCounters *_counters;
+   PcCounters _outside;			// PCs outside the text segment
+
+   std::vector<Symbol> _syms;		// Sorted by address
+
+   // Call graph state. A call's target is the PC retired after its delay
+   // slot, which also covers jalr; returns are jr $ra.
+   struct Frame {
+      int _func;
+      LL _start;
+   };
+   unsigned int _callSite;
+   int _callCountdown;
+   Bool _pendingReturn;
+   std::vector<Frame> _stack;
+   std::map<std::pair<int,int>, LL> _edges;	// (caller, callee) -> calls
+   std::map<int, LL> _inclusive;		// callee -> inclusive cycles
+};
+
+#endif /* __PROFILER_H__ */
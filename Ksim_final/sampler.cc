@@ -0,0 +1,217 @@
+#include "sampler.h"
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+MipcSampler::MipcSampler (void)
+{
+   _enabled = ParamGetInt ("Mipc.Sample.Enable") ? TRUE : FALSE;
+   _functional = (_enabled && !strcmp (ParamGetString ("Mipc.Sample.Mode"), "functional")) ? TRUE : FALSE;
+   _child = FALSE;
+   _period = ParamGetLL ("Mipc.Sample.Period");
+   _warmup = ParamGetLL ("Mipc.Sample.Warmup");
+   _interval = ParamGetLL ("Mipc.Sample.Interval");
+   _jobs = ParamGetInt ("Mipc.Sample.Jobs");
+
+   if (_interval <= 0) _interval = 1;
+   if (_warmup < 0) _warmup = 0;
+   if (_period < _warmup + _interval) _period = _warmup + _interval;
+   if (_jobs <= 0) _jobs = sysconf (_SC_NPROCESSORS_ONLN);
+   if (_jobs <= 0) _jobs = 1;
+
+   _state = SAMPLE_SKIP;
+   _periodStart = 0;
+   _nextBoundary = 0;
+   _unitStartInst = 0;
+   _unitStartCycle = 0;
+
+   _nunits = 0;
+   _nforked = 0;
+   _sumCpi = 0.0;
+   _sumSqCpi = 0.0;
+
+   _results[0] = -1;
+   _results[1] = -1;
+}
+
+MipcSampler::~MipcSampler (void) {}
+
+void
+MipcSampler::AddUnit (double cpi)
+{
+   _sumCpi += cpi;
+   _sumSqCpi += cpi*cpi;
+   _nunits++;
+}
+
+void
+MipcSampler::Advance (LL ninsts, LL cycle)
+{
+   switch (_state) {
+   case SAMPLE_SKIP:
+      _periodStart = _nextBoundary;
+      _state = SAMPLE_WARM;
+      _nextBoundary = _periodStart + _warmup;
+      if (ninsts < _nextBoundary) break;
+      /* no warm-up requested, start measuring right away */
+
+   case SAMPLE_WARM:
+      _state = SAMPLE_MEASURE;
+      _unitStartInst = ninsts;
+      _unitStartCycle = cycle;
+      _nextBoundary = ninsts + _interval;
+      break;
+
+   case SAMPLE_MEASURE:
+      {
+         double cpi = ((double)(cycle - _unitStartCycle))/(ninsts - _unitStartInst);
+         if (_child) {
+            // A single double is well under PIPE_BUF, so the write is atomic
+            if (write (_results[1], &cpi, sizeof (cpi)) != sizeof (cpi)) _exit (1);
+            _exit (0);
+         }
+         AddUnit (cpi);
+      }
+      _state = SAMPLE_SKIP;
+      _nextBoundary = _periodStart + _period;
+      if (_nextBoundary <= ninsts) _nextBoundary = ninsts + 1;
+      break;
+   }
+}
+
+/*------------------------------------------------------------------------
+ *
+ *  MipcSampler::RunFunctional --
+ *
+ *   Fast-forwards to the start of each unit and forks a child to simulate
+ *   it, keeping at most _jobs children alive. Each child returns from here
+ *   into the detailed pipeline; the parent returns once the program has
+ *   exited and every child has reported.
+ *
+ *------------------------------------------------------------------------
+ */
+void
+MipcSampler::RunFunctional (Mipc *mc)
+{
+   LL unitStart = 0;
+   int running = 0;
+   pid_t pid;
+
+   if (pipe (_results) < 0) {
+      fatal_error ("Could not create the sampling pipe: %s", strerror (errno));
+   }
+   fcntl (_results[0], F_SETFL, O_NONBLOCK);
+
+   while (1) {
+      mc->FastForward (unitStart);
+      if (mc->_sim_exit) break;
+
+      while (running >= _jobs) {
+         running -= Reap (TRUE);
+      }
+      fflush (NULL);	// or the children flush the parent's buffers again
+      pid = fork ();
+      if (pid < 0) {
+         fatal_error ("Could not fork a sampling unit: %s", strerror (errno));
+      }
+      if (pid == 0) {
+         StartChild (mc);
+         return;
+      }
+      running++;
+      _nforked++;
+      running -= Reap (FALSE);
+      unitStart += _period;
+   }
+
+   while (running > 0) {
+      running -= Reap (TRUE);
+   }
+   close (_results[0]);
+   close (_results[1]);
+}
+
+void
+MipcSampler::StartChild (Mipc *mc)
+{
+   int null = open ("/dev/null", O_WRONLY);
+
+   _child = TRUE;
+   close (_results[0]);
+   if (null >= 0) {
+      dup2 (null, 1);	// the guest's output belongs to the parent's run
+      close (null);
+   }
+#ifdef MIPC_DEBUG
+   fclose (mc->_debugLog);
+   mc->_debugLog = fopen ("/dev/null", "w");
+#endif
+
+   // Warm up and measure from here, then report from Advance
+   _state = SAMPLE_SKIP;
+   _nextBoundary = mc->_nfetched;
+}
+
+void
+MipcSampler::ChildExit (void)
+{
+   _exit (0);
+}
+
+int
+MipcSampler::Reap (Bool block)
+{
+   int status;
+   int n = 0;
+   double cpi;
+
+   while (waitpid (-1, &status, (block && n == 0) ? 0 : WNOHANG) > 0) {
+      n++;
+   }
+   // Children write before they exit, so whatever they reported is here
+   while (read (_results[0], &cpi, sizeof (cpi)) == sizeof (cpi)) {
+      AddUnit (cpi);
+   }
+   return n;
+}
+
+void
+MipcSampler::Dumpstats (Log *l, LL ninsts)
+{
+   double mean, var, ci;
+
+   if (!_enabled) return;
+
+   if (_functional) {
+      l->print ("Sampling units: %llu of %llu forked, up to %d at once (period %llu, warm-up %llu, interval %llu)",
+                _nunits, _nforked, _jobs, _period, _warmup, _interval);
+   }
+   else {
+      l->print ("Sampling units: %llu (period %llu, warm-up %llu, interval %llu)",
+                _nunits, _period, _warmup, _interval);
+   }
+   if (_nunits == 0) {
+      l->print ("Sampled CPI: n/a (program shorter than one sampling unit)");
+      return;
+   }
+
+   mean = _sumCpi/_nunits;
+   var = 0.0;
+   if (_nunits > 1) {
+      var = (_sumSqCpi - _nunits*mean*mean)/(_nunits - 1);
+      if (var < 0.0) var = 0.0;
+   }
+   // 95% confidence interval on the mean (normal approximation)
+   ci = 1.96*sqrt(var/_nunits);
+
+   l->print ("Sampled CPI: %.4f +/- %.4f (95%% confidence, %.2f%% relative)",
+             mean, ci, mean > 0.0 ? 100.0*ci/mean : 0.0);
+   if (_functional) {
+      // There is no exact count in this mode; the estimate stands in for it
+      l->print ("Estimated simulated cycles: %.0f +/- %.0f",
+                mean*ninsts, ci*ninsts);
+   }
+}
@@ -0,0 +1,81 @@
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+#include "mips.h"
+
+// Systematic (SMARTS-style) sampling of the detailed pipeline.
+//
+// The dynamic instruction stream is cut into periods of Mipc.Sample.Period
+// instructions. At the start of every period the pipeline runs
+// Mipc.Sample.Warmup instructions to refill its state, then measures the
+// cycles spent on the next Mipc.Sample.Interval instructions. The per-unit
+// CPIs are combined into a whole-program estimate with a confidence bound.
+//
+// Mipc.Sample.Mode picks how the units are reached:
+//
+//   detailed	 the whole program goes through the pipeline and the units
+//		 are measured along the way. Nothing is saved, but the exact
+//		 CPI of the same run is there to check the estimate against.
+//
+//   functional	 the program runs functionally (Mipc::FastForward) and at
+//		 the start of each unit the simulator forks. The child is a
+//		 snapshot of the whole simulator at that point; it runs the
+//		 unit through the detailed pipeline, sends its CPI back over
+//		 a pipe and exits, while the parent carries on to the next
+//		 unit. Up to Mipc.Sample.Jobs children (0: one per host core)
+//		 run at once. The pipeline models no caches, so the warm-up
+//		 only has to refill the pipeline itself.
+//
+// Children discard the guest's standard output and the pipeline trace;
+// anything else the guest writes (files it opens) is written by them too.
+// The parent keeps no simulated time, so the cycle, interlock and stall
+// counts are left out of its statistics, and guest performance counters
+// read outside a unit see no cycles.
+
+class MipcSampler {
+public:
+   MipcSampler ();
+   ~MipcSampler ();
+
+   // Called once per simulated cycle; only boundary crossings do work
+   void Tick (LL ninsts, LL cycle) {
+      if (_enabled && ninsts >= _nextBoundary) Advance (ninsts, cycle);
+   }
+   void Dumpstats (Log *l, LL ninsts);	// Prints the sampled CPI estimate
+
+   // Functional mode: runs the program to the end in the parent and
+   // returns there, or returns in a forked child that is to simulate one
+   // unit in detail
+   void RunFunctional (Mipc *mc);
+   void ChildExit (void);		// The program ended inside the child's unit
+
+   Bool _enabled;
+   Bool _functional;			// Mipc.Sample.Mode = functional
+   Bool _child;				// This process simulates a single unit
+
+private:
+   void Advance (LL ninsts, LL cycle);
+   void AddUnit (double cpi);
+   void StartChild (Mipc *mc);
+   int Reap (Bool block);		// Returns the number of children reaped
+
+   enum { SAMPLE_SKIP, SAMPLE_WARM, SAMPLE_MEASURE };
+
+   LL _period;				// Instructions between unit starts
+   LL _warmup;				// Warm-up instructions per unit
+   LL _interval;			// Measured instructions per unit
+   int _jobs;				// Concurrent children in functional mode
+
+   int _state;
+   LL _periodStart;			// Instruction count at start of period
+   LL _nextBoundary;			// Instruction count of next transition
+   LL _unitStartInst, _unitStartCycle;
+
+   LL _nunits;				// Completed sampling units
+   LL _nforked;				// Units handed to children
+   double _sumCpi, _sumSqCpi;
+
+   int _results[2];			// Pipe from the children to the parent
+};
+
+#endif /* __SAMPLER_H__ */
@@ -0,0 +1,22 @@
+#ifndef ALIGNED_H
+#define ALIGNED_H
+
+#include <stdlib.h>
+
+/*
+ * Base for per-thread state that other threads' state must not share a
+ * cache line with. Deriving from it gives the class 64-byte alignment, and
+ * its operator new keeps that alignment on the heap: plain new only
+ * guarantees 16 bytes before C++17. The base is empty, so it adds no size.
+ */
+struct alignas(64) CacheAligned {
+    static VOID* operator new(size_t size) {
+        VOID* memory = NULL;
+        INT32 error = posix_memalign(&memory, alignof(CacheAligned), size);
+        ASSERTX(error == 0);
+        return memory;
+    }
+    static VOID operator delete(VOID* memory) { free(memory); }
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Per-branch cost of the HW2 direction predictors without Pin.
+ *
+ *     g++ -std=c++14 -O2 [-mavx2] -I.. predictor_cost.cpp -o predictor_cost
+ *     ./predictor_cost [pressure]
+ *
+ * Each configuration is timed the way HW2's -branch_cost times
+ * UpdateDirectionPredictors: two timestamp reads around the predictor
+ * update, summed over the branches. The branch stream is synthetic, 3000
+ * static branches with a mix of biased and periodic outcomes, and between
+ * branches the loop touches `pressure` random words (default 16) of a 256 KB
+ * array, standing in for the application's own cache footprint. The
+ * numbers include the timestamp reads; compare rows rather than trusting
+ * them as absolute costs.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include <vector>
+#include <x86intrin.h>
+
+typedef uint64_t UINT64;
+typedef int64_t INT64;
+typedef uint32_t UINT32;
+typedef int32_t INT32;
+typedef uint16_t UINT16;
+typedef uint8_t UINT8;
+typedef int8_t INT8;
+typedef bool BOOL;
+typedef void VOID;
+typedef uint64_t ADDRINT;
+
+#include "predictors.h"
+
+static const UINT32 PACK2 = PackedSlot<2>::VALUE;
+static const UINT32 PACK3 = PackedSlot<3>::VALUE;
+
+// The eight predictors of the assignment, as in HW2.cpp
+typedef PredictorSet<Fnbt, Bimodal<512, 2>, SAg<1024, 9, 2>, GAg<9, 3>, GShare<9, 3>, Tournament<2, 3, 9, 2>, Majority<2, 3, 4>,
+                     Tournament3<2, 3, 4, 9, 2> > Assignment;
+typedef PredictorSet<Fnbt, Bimodal<512, 2, PACK2>, SAg<1024, 9, 2, PACK2>, GAg<9, 3, PACK3>, GShare<9, 3, PACK3>, Tournament<2, 3, 9, 2, PACK2>,
+                     Majority<2, 3, 4>, Tournament3<2, 3, 4, 9, 2, PACK2> > AssignmentPacked;
+
+// Larger tables, where the footprint starts to matter
+typedef PredictorSet<Bimodal<65536, 2>, GShare<16, 2>, Tournament<0, 1, 16, 2> > Large;
+typedef PredictorSet<Bimodal<65536, 2, PACK2>, GShare<16, 2, PACK2>, Tournament<0, 1, 16, 2, PACK2> > LargePacked;
+
+typedef PredictorSet<Tage<13, 12, 10, 11, 4, 640> > TageBytes;
+typedef PredictorSet<Tage<13, 12, 10, 11, 4, 640, PACK2> > TagePacked;
+
+struct Stream {
+    std::vector<ADDRINT> pc;
+    std::vector<ADDRINT> target;
+    std::vector<UINT8> taken;
+};
+
+volatile UINT64 sinkHole; // keeps the application loop from being optimized away
+
+static const UINT32 BRANCHES = 1 << 20;
+static const UINT32 REPEATS = 8;
+static const UINT32 APPLICATION_WORDS = 1 << 15;
+
+template <typename Set>
+VOID Measure(const char* name, const Stream& stream, UINT32 pressure) {
+    Set* set = new Set;
+    std::vector<UINT64> application(APPLICATION_WORDS);
+    std::mt19937_64 rng(2);
+    UINT64 cycles = 0;
+    UINT64 sink = 0;
+    for (UINT32 repeat = 0; repeat < REPEATS; repeat++) {
+        for (UINT32 i = 0; i < BRANCHES; i++) {
+            for (UINT32 k = 0; k < pressure; k++) {
+                sink += application[(rng() >> 3) & (APPLICATION_WORDS - 1)]++;
+            }
+            BOOL mispredicted[Set::SIZE];
+            UINT64 start = __rdtsc();
+            set->Access(stream.pc[i], stream.target[i], stream.taken[i], mispredicted);
+            cycles += __rdtsc() - start;
+            sink += mispredicted[0];
+        }
+    }
+    sinkHole = sink;
+    printf("%-20s %7.1f cycles per branch\n", name, 1.0 * cycles / (REPEATS * BRANCHES));
+    delete set;
+}
+
+int main(int argc, char* argv[]) {
+    UINT32 pressure = argc > 1 ? atoi(argv[1]) : 16;
+    Stream stream;
+    std::mt19937_64 rng(1);
+    for (UINT32 i = 0; i < BRANCHES; i++) {
+        UINT32 branch = rng() % 3000;
+        stream.pc.push_back(0x400000 + branch * 37);
+        stream.target.push_back(stream.pc.back() + ((branch & 1) ? 64 : -64));
+        stream.taken.push_back((branch % 3) ? (rng() % 10 < 8) : (i % 5 != 0));
+    }
+    Measure<Assignment>("assignment", stream, pressure);
+    Measure<AssignmentPacked>("assignment packed", stream, pressure);
+    Measure<Large>("64K tables", stream, pressure);
+    Measure<LargePacked>("64K tables packed", stream, pressure);
+    Measure<TageBytes>("TAGE", stream, pressure);
+    Measure<TagePacked>("TAGE packed base", stream, pressure);
+    return 0;
+}
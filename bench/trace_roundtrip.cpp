@@ -0,0 +1,191 @@
+/*
+ * Record/replay check of the -trace format without Pin.
+ *
+ *     g++ -std=c++14 -O2 -I.. trace_roundtrip.cpp -o trace_roundtrip
+ *     ./trace_roundtrip [records] [directory]
+ *
+ * Raw entries are built the way Pin fills the trace buffer: every field is
+ * stored with the width of its IARG type, in the order TraceRecorder
+ * inserts them, over a buffer that starts out as garbage. They go through
+ * TraceFileWriter in buffer-sized batches and are read back with
+ * TraceReader. The program times a replay pass that only consumes the
+ * records, then checks every record in a second pass and compares the
+ * number of taken conditional branches. The rate is given against the
+ * file and against the raw entries Pin buffered, which is the data a
+ * replay stands in for.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "traceencoder.h"
+#include "tracereader.h"
+
+static const uint32_t BLOCKS = 3000;
+static const uint32_t BATCH = 4096; // entries per Pin buffer with -buffer_pages 16
+
+// Stores `value` at `offset` with the width of the IARG that fills it
+template <typename Field>
+void Fill(TraceEntry& entry, size_t offset, Field value) {
+    memcpy((uint8_t*) &entry + offset, &value, sizeof(value));
+}
+
+struct Expected {
+    uint32_t id;
+    std::vector<uint64_t> addresses;
+    std::vector<uint8_t> present;
+    bool taken;
+    uint64_t target;
+};
+
+int main(int argc, char* argv[]) {
+    uint64_t records = argc > 1 ? strtoull(argv[1], NULL, 0) : 4000000;
+    std::string prefix = std::string(argc > 2 ? argv[2] : "/tmp") + "/trace_roundtrip";
+
+    std::mt19937_64 rng(1);
+    TraceStaticTable table;
+    for (uint32_t b = 0; b < BLOCKS; b++) {
+        TraceBbl bbl;
+        bbl.address = 0x400000 + b * 48;
+        bbl.numPredicated = 0;
+        bbl.branchKind = b % 4 == 3 ? TRACE_BRANCH_INDIRECT : b % 4 ? TRACE_BRANCH_CONDITIONAL : TRACE_BRANCH_NONE;
+        uint32_t numIns = 1 + rng() % 8;
+        for (uint32_t i = 0; i < numIns; i++) {
+            bbl.sizes.push_back(1 + rng() % 7);
+            bbl.categories.push_back(rng() % 40);
+        }
+        for (uint32_t m = 0, numMemOps = rng() % 4; m < numMemOps; m++) {
+            TraceMemOp op;
+            op.instruction = m % numIns;
+            op.size = 8;
+            op.flags = TRACE_MEMORY_READ | (b % 13 == 0 ? TRACE_MEMORY_PREDICATED : 0);
+            bbl.numPredicated += b % 13 == 0;
+            bbl.memOps.push_back(op);
+        }
+        table.Add(bbl);
+    }
+
+    std::vector<Expected> expected;
+    std::vector<TraceEntry> entries;
+    std::vector<uint64_t> stream(table.MemOps());
+    uint64_t takenRecorded = 0;
+    for (uint64_t r = 0; r < records; r++) {
+        Expected x;
+        x.id = rng() % BLOCKS;
+        const TraceBbl& bbl = table[x.id];
+        TraceEntry entry;
+        memset(&entry, 0xA5, sizeof(entry));
+        Fill<uint32_t>(entry, offsetof(TraceEntry, id), x.id);
+        Fill<uint32_t>(entry, offsetof(TraceEntry, kind), TRACE_ENTRY_BBL);
+        entries.push_back(entry);
+        for (uint32_t m = 0; m < bbl.memOps.size(); m++) {
+            bool present = !(bbl.memOps[m].flags & TRACE_MEMORY_PREDICATED) || (rng() & 1);
+            uint64_t& address = stream[bbl.firstMemOp + m];
+            address += (rng() % 8 == 0) ? (rng() % 4096) * 8 : 8;
+            x.addresses.push_back(address);
+            x.present.push_back(present);
+            if (present) {
+                memset(&entry, 0xA5, sizeof(entry));
+                Fill<uint64_t>(entry, offsetof(TraceEntry, value), address);
+                Fill<uint32_t>(entry, offsetof(TraceEntry, id), m);
+                Fill<uint32_t>(entry, offsetof(TraceEntry, kind), TRACE_ENTRY_MEMORY);
+                entries.push_back(entry);
+            }
+        }
+        x.taken = bbl.branchKind == TRACE_BRANCH_INDIRECT || rng() % 10 < 6;
+        x.target = bbl.branchKind == TRACE_BRANCH_INDIRECT ? 0x500000 + (rng() % 4) * 64 : bbl.address + 96;
+        if (bbl.branchKind != TRACE_BRANCH_NONE) {
+            memset(&entry, 0xA5, sizeof(entry));
+            Fill<uint64_t>(entry, offsetof(TraceEntry, value), x.target);
+            Fill<bool>(entry, offsetof(TraceEntry, taken), x.taken);
+            Fill<uint32_t>(entry, offsetof(TraceEntry, kind), TRACE_ENTRY_BRANCH);
+            entries.push_back(entry);
+            takenRecorded += bbl.branchKind == TRACE_BRANCH_CONDITIONAL && x.taken;
+        }
+        expected.push_back(x);
+    }
+
+    std::string tracePath = prefix + ".0.trace";
+    std::string staticPath = prefix + ".static";
+    std::chrono::steady_clock::time_point encodeStart = std::chrono::steady_clock::now();
+    {
+        TraceFileWriter writer(tracePath, 0);
+        writer.Sync(table);
+        for (size_t e = 0; e < entries.size(); e += BATCH) {
+            writer.Append(&entries[e], std::min<size_t>(BATCH, entries.size() - e));
+        }
+        writer.Close();
+    }
+    double encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - encodeStart).count();
+    table.Write(staticPath.c_str());
+
+    TraceStaticTable replayTable;
+    TraceReader reader;
+    if (!replayTable.Read(staticPath.c_str()) || !reader.Open(tracePath.c_str(), &replayTable)) {
+        printf("FAIL: cannot open %s\n", tracePath.c_str());
+        return 1;
+    }
+    TraceRecord record;
+    uint64_t replayed = 0;
+    uint64_t checksum = 0;
+    double seconds = 1e30;
+    for (uint32_t pass = 0; pass < 3; pass++) {
+        reader.Open(tracePath.c_str(), &replayTable);
+        replayed = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (reader.Next(record)) {
+            for (uint32_t m = 0; m < record.bbl->memOps.size(); m++) {
+                checksum += record.addresses[m] & -(uint64_t) record.present[m];
+            }
+            checksum += record.target + record.taken;
+            replayed++;
+        }
+        seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    reader.Open(tracePath.c_str(), &replayTable);
+    uint64_t checked = 0;
+    uint64_t takenReplayed = 0;
+    uint64_t mismatches = 0;
+    while (reader.Next(record)) {
+        const Expected& x = expected[checked];
+        if (record.id != x.id) {
+            mismatches++;
+        } else {
+            for (uint32_t m = 0; m < x.addresses.size(); m++) {
+                mismatches += record.present[m] != x.present[m] || (x.present[m] && record.addresses[m] != x.addresses[m]);
+            }
+            if (record.bbl->branchKind == TRACE_BRANCH_CONDITIONAL) {
+                mismatches += record.taken != x.taken;
+                takenReplayed += record.taken;
+            } else if (record.bbl->branchKind == TRACE_BRANCH_INDIRECT) {
+                mismatches += record.target != x.target;
+            }
+        }
+        checked++;
+    }
+
+    struct stat st;
+    stat(tracePath.c_str(), &st);
+    uint64_t rawBytes = entries.size() * sizeof(TraceEntry);
+    printf("%llu records, %.2f bytes per record, %.1fx smaller than the raw entries\n", (unsigned long long) replayed,
+           1.0 * st.st_size / replayed, 1.0 * rawBytes / st.st_size);
+    printf("taken conditional branches: recorded %llu, replayed %llu\n", (unsigned long long) takenRecorded,
+           (unsigned long long) takenReplayed);
+    printf("record: %.1f M records/s\n", records / encodeSeconds / 1e6);
+    printf("replay: %.1f M records/s, %.0f MB/s of trace, %.2f GB/s of raw entries (checksum %llx)\n", replayed / seconds / 1e6,
+           st.st_size / seconds / 1e6, rawBytes / seconds / 1e9, (unsigned long long) checksum);
+    if (replayed != records || checked != records || takenReplayed != takenRecorded || mismatches) {
+        printf("FAIL: %llu mismatches\n", (unsigned long long) mismatches);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef BTB_H
+#define BTB_H
+
+#include <type_traits>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+enum BtbOutcome {
+    BTB_HIT,        // right target
+    BTB_MISPREDICT, // entry found, but the target was wrong or the branch fell through
+    BTB_MISS        // no entry; one is allocated
+};
+
+template <UINT32 N>
+struct Log2 {
+    static_assert(N && (N & (N - 1)) == 0, "sizes must be powers of two");
+    static const UINT32 VALUE = 1 + Log2<N / 2>::VALUE;
+};
+template <>
+struct Log2<1> {
+    static const UINT32 VALUE = 0;
+};
+
+// Set index from the low bits of the branch address. Those bits are implied
+// by the set, so the tag starts above them.
+struct PcIndex {
+    static const BOOL PC_ONLY = true;
+    static UINT64 Index(ADDRINT pc, UINT64 history) { return pc; }
+};
+
+// Set index from the branch address XOR the last HistoryBits global outcomes
+template <UINT32 HistoryBits>
+struct PcXorHistoryIndex {
+    static const BOOL PC_ONLY = false;
+    static UINT64 Index(ADDRINT pc, UINT64 history) { return pc ^ (history & ((1ULL << HistoryBits) - 1)); }
+};
+
+/*
+ * Branch target buffer of Sets x Ways entries stored as flat per-set
+ * arrays: the tags of one set are contiguous, so a lookup compares all of
+ * them with a few SSE2 compares, and the targets sit in a parallel
+ * array that is only read on a hit. Tags are TagBits bits of the branch
+ * address, kept shifted left by one with the low bit set, so a zero slot is
+ * an empty way and never matches. Replacement is tree pseudo-LRU: Ways - 1
+ * bits per set, each pointing at the half of its subtree used less
+ * recently.
+ */
+template <UINT32 Sets, UINT32 Ways, UINT32 TagBits, typename IndexHash>
+class Btb {
+  public:
+    static_assert(Ways >= 2 && Ways <= 32, "a set has 2 to 32 ways");
+    static_assert(TagBits >= 1 && TagBits <= 31, "tags are at most 31 bits");
+    typedef typename std::conditional<(TagBits < 16), UINT16, UINT32>::type Tag;
+    static const UINT32 LOG_WAYS = Log2<Ways>::VALUE;
+    static const UINT32 TAG_SHIFT = IndexHash::PC_ONLY ? Log2<Sets>::VALUE : 0;
+    static const UINT64 STORAGE_BITS = (UINT64) Sets * (Ways * (1 + TagBits + 8 * sizeof(ADDRINT)) + Ways - 1);
+
+    Btb() : tags(), targets(), plru() {}
+
+    BtbOutcome Access(ADDRINT pc, UINT64 history, ADDRINT target, BOOL taken) {
+        UINT32 set = IndexHash::Index(pc, history) & (Sets - 1);
+        Tag tag = (Tag) ((((pc >> TAG_SHIFT) & ((1ULL << TagBits) - 1)) << 1) | 1);
+        UINT32 way = Find(tags[set], tag);
+        if (way == Ways) {
+            way = Find(tags[set], 0);
+            if (way == Ways) {
+                way = Victim(plru[set]);
+            }
+            tags[set][way] = tag;
+            targets[set][way] = target;
+            Touch(plru[set], way);
+            return BTB_MISS;
+        }
+        Touch(plru[set], way);
+        if (targets[set][way] != target) {
+            targets[set][way] = target;
+            return BTB_MISPREDICT;
+        }
+        return taken ? BTB_HIT : BTB_MISPREDICT;
+    }
+
+  private:
+    // First way of the set holding `tag`, or Ways
+    static UINT32 Find(const Tag* set, Tag tag) {
+#if defined(__SSE2__)
+        if (((Ways * sizeof(Tag)) % 16 == 0 && Ways * sizeof(Tag) <= 64) || Ways * sizeof(Tag) == 8) {
+            __m128i key = sizeof(Tag) == 2 ? _mm_set1_epi16((short) tag) : _mm_set1_epi32((int) tag);
+            UINT64 bytes = 0; // one bit per byte of the set, set where a matching tag is
+            for (UINT32 i = 0; i < Ways * sizeof(Tag); i += 16) {
+                __m128i chunk = Ways * sizeof(Tag) == 8 ? _mm_loadl_epi64((const __m128i*) set)
+                                                        : _mm_loadu_si128((const __m128i*) ((const UINT8*) set + i));
+                __m128i equal = sizeof(Tag) == 2 ? _mm_cmpeq_epi16(chunk, key) : _mm_cmpeq_epi32(chunk, key);
+                bytes |= (UINT64) (UINT32) _mm_movemask_epi8(equal) << i;
+            }
+            if (Ways * sizeof(Tag) == 8) {
+                bytes &= 0xFF;
+            }
+            return bytes ? __builtin_ctzll(bytes) / sizeof(Tag) : Ways;
+        }
+#endif
+        for (UINT32 way = 0; way < Ways; way++) {
+            if (set[way] == tag) {
+                return way;
+            }
+        }
+        return Ways;
+    }
+
+    // Points every node on the way's path away from it
+    static VOID Touch(UINT32& bits, UINT32 way) {
+        for (UINT32 level = 0, node = 0; level < LOG_WAYS; level++) {
+            UINT32 right = (way >> (LOG_WAYS - 1 - level)) & 1;
+            bits = (bits & ~(1U << node)) | ((right ^ 1) << node);
+            node = 2 * node + 1 + right;
+        }
+    }
+
+    // Follows the nodes to the least recently used half at each level
+    static UINT32 Victim(UINT32 bits) {
+        UINT32 way = 0;
+        for (UINT32 level = 0, node = 0; level < LOG_WAYS; level++) {
+            UINT32 right = (bits >> node) & 1;
+            way = 2 * way + right;
+            node = 2 * node + 1 + right;
+        }
+        return way;
+    }
+
+    Tag tags[Sets][Ways];
+    ADDRINT targets[Sets][Ways];
+    UINT32 plru[Sets];
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstddef>
+#include <vector>
+
+enum ReplacementPolicy : UINT32 {
+    REPLACE_LRU,
+    REPLACE_PLRU,
+    REPLACE_RRIP
+};
+
+/*
+ * One set-associative cache level, addressed by line number.
+ *
+ * Tags live in one flat array, set-major, so a lookup is a linear scan over
+ * `ways` adjacent words. Replacement state is kept beside it: an access stamp
+ * per way for LRU, a (ways - 1)-bit tree per set for PLRU, and a 2-bit
+ * re-reference prediction value per way for RRIP (SRRIP, inserting at 2).
+ * Sets and ways must be powers of two; ways is at most 64.
+ */
+class Cache {
+  public:
+    Cache(UINT64 sizeBytes, UINT32 assoc, UINT32 lineShift, ReplacementPolicy policy, UINT32 latency)
+        : ways(assoc), sets(sizeBytes >> lineShift), policy(policy), latency(latency), hits(0), misses(0), clock(0) {
+        sets = sets / ways ? sets / ways : 1;
+        setMask = sets - 1;
+        for (waysLog = 0; (1U << waysLog) < ways; waysLog++) {
+        }
+        tags.assign((size_t) sets * ways, (UINT64) INVALID_TAG);
+        if (policy == REPLACE_LRU) {
+            stamps.assign((size_t) sets * ways, 0);
+        } else if (policy == REPLACE_PLRU) {
+            trees.assign(sets, 0);
+        } else {
+            rrpv.assign((size_t) sets * ways, (UINT8) RRPV_MAX);
+        }
+    }
+
+    static BOOL ValidGeometry(UINT64 sizeBytes, UINT32 assoc, UINT32 lineShift) {
+        UINT64 lines = sizeBytes >> lineShift;
+        return assoc > 0 && assoc <= 64 && (assoc & (assoc - 1)) == 0 && lines >= assoc && (lines & (lines - 1)) == 0;
+    }
+
+    // Looks the line up, filling it on a miss. Returns true on a hit.
+    BOOL Access(UINT64 line) {
+        UINT32 set = line & setMask;
+        UINT64* setTags = &tags[(size_t) set * ways];
+        for (UINT32 way = 0; way < ways; way++) {
+            if (setTags[way] == line) {
+                hits++;
+                Touch(set, way);
+                return true;
+            }
+        }
+        misses++;
+        UINT32 way = Victim(set);
+        setTags[way] = line;
+        Insert(set, way);
+        return false;
+    }
+
+    UINT32 Latency() const { return latency; }
+    UINT64 Hits() const { return hits; }
+    UINT64 Misses() const { return misses; }
+    UINT64 Accesses() const { return hits + misses; }
+
+    // Adds the hits and misses of another cache, for totals over several
+    VOID AddCounts(const Cache& other) {
+        hits += other.hits;
+        misses += other.misses;
+    }
+
+  private:
+    static const UINT64 INVALID_TAG = ~0ULL;
+    static const UINT8 RRPV_MAX = 3;
+
+    VOID Touch(UINT32 set, UINT32 way) {
+        switch (policy) {
+        case REPLACE_LRU:
+            stamps[(size_t) set * ways + way] = ++clock;
+            break;
+        case REPLACE_PLRU: {
+            // Point every node on the path away from the way just used
+            UINT64& tree = trees[set];
+            UINT32 node = 1;
+            for (INT32 level = waysLog - 1; level >= 0; level--) {
+                UINT32 bit = (way >> level) & 1;
+                if (bit) {
+                    tree &= ~(1ULL << node);
+                } else {
+                    tree |= 1ULL << node;
+                }
+                node = 2 * node + bit;
+            }
+            break;
+        }
+        case REPLACE_RRIP:
+            rrpv[(size_t) set * ways + way] = 0;
+            break;
+        }
+    }
+
+    VOID Insert(UINT32 set, UINT32 way) {
+        if (policy == REPLACE_RRIP) {
+            rrpv[(size_t) set * ways + way] = RRPV_MAX - 1;
+        } else {
+            Touch(set, way);
+        }
+    }
+
+    UINT32 Victim(UINT32 set) {
+        const UINT64* setTags = &tags[(size_t) set * ways];
+        for (UINT32 way = 0; way < ways; way++) {
+            if (setTags[way] == INVALID_TAG) {
+                return way;
+            }
+        }
+        switch (policy) {
+        case REPLACE_LRU: {
+            const UINT64* setStamps = &stamps[(size_t) set * ways];
+            UINT32 victim = 0;
+            for (UINT32 way = 1; way < ways; way++) {
+                victim = (setStamps[way] < setStamps[victim]) ? way : victim;
+            }
+            return victim;
+        }
+        case REPLACE_PLRU: {
+            UINT64 tree = trees[set];
+            UINT32 node = 1;
+            for (UINT32 level = 0; level < waysLog; level++) {
+                node = 2 * node + ((tree >> node) & 1);
+            }
+            return node - ways;
+        }
+        default: {
+            UINT8* setRrpv = &rrpv[(size_t) set * ways];
+            while (true) {
+                for (UINT32 way = 0; way < ways; way++) {
+                    if (setRrpv[way] == RRPV_MAX) {
+                        return way;
+                    }
+                }
+                for (UINT32 way = 0; way < ways; way++) {
+                    setRrpv[way]++;
+                }
+            }
+        }
+        }
+    }
+
+    UINT32 ways;
+    UINT32 waysLog;
+    UINT32 sets;
+    UINT32 setMask;
+    ReplacementPolicy policy;
+    UINT32 latency;
+    UINT64 hits;
+    UINT64 misses;
+    UINT64 clock;
+    std::vector<UINT64> tags;
+    std::vector<UINT64> stamps;
+    std::vector<UINT64> trees;
+    std::vector<UINT8> rrpv;
+};
+
+#endif
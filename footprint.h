@@ -0,0 +1,154 @@
+#ifndef FOOTPRINT_H
+#define FOOTPRINT_H
+
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+
+/*
+ * Sparse bitmap of touched blocks, one bit per (1 << blockShift) bytes.
+ *
+ * Block numbers are split into a three-level radix directory (512 entries,
+ * 4 KB per node) above 4 KB leaf pages of 32768 bits. Nodes and leaves are
+ * allocated on first touch only, and the most recently used leaf is cached,
+ * so the common path is a compare, a couple of shifts and a bit test.
+ *
+ * The directory covers block numbers below 2^42, which is every user-space
+ * address under four-level paging at the block sizes in use. Blocks above
+ * that (five-level paging, or byte-sized blocks) are kept exactly in a
+ * hash set instead of aliasing into low blocks.
+ */
+class FootprintBitmap {
+  public:
+    explicit FootprintBitmap(UINT32 blockShift) : shift(blockShift), blocks(0), lastLeafIndex(~0ULL), lastLeaf(NULL) {
+        memset(root, 0, sizeof(root));
+    }
+
+    ~FootprintBitmap() { Free(root, 0); }
+
+    // Marks every block overlapped by [address, address + size)
+    VOID Touch(ADDRINT address, UINT32 size) {
+        UINT64 first = address >> shift;
+        UINT64 last = (address + (size ? size - 1 : 0)) >> shift;
+        for (UINT64 block = first; block <= last; block++) {
+            Mark(block);
+        }
+    }
+
+    VOID Mark(UINT64 block) {
+        if (block > BLOCK_MASK) {
+            blocks += outOfRange.insert(block).second;
+            return;
+        }
+        UINT64* leaf = Leaf(block >> LEAF_BITS);
+        UINT64 bit = block & ((1ULL << LEAF_BITS) - 1);
+        UINT64 mask = 1ULL << (bit & 63);
+        UINT64& word = leaf[bit >> 6];
+        if (!(word & mask)) {
+            word |= mask;
+            blocks++;
+        }
+    }
+
+    BOOL Test(UINT64 block) const {
+        if (block > BLOCK_MASK) {
+            return outOfRange.count(block) != 0;
+        }
+        UINT64 leafIndex = block >> LEAF_BITS;
+        VOID* const* node = root;
+        for (INT32 level = LEVELS - 1; level >= 0; level--) {
+            VOID* next = node[(leafIndex >> (level * DIR_BITS)) & DIR_MASK];
+            if (next == NULL) {
+                return false;
+            }
+            node = (VOID* const*) next;
+        }
+        UINT64 bit = block & ((1ULL << LEAF_BITS) - 1);
+        return (((const UINT64*) node)[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    // Marks every block marked in `other`, which must have the same block size
+    VOID Merge(const FootprintBitmap& other) {
+        MergeNode(other.root, LEVELS - 1, 0);
+        for (UINT64 block : other.outOfRange) {
+            blocks += outOfRange.insert(block).second;
+        }
+    }
+
+    UINT32 BlockShift() const { return shift; }
+    UINT64 Blocks() const { return blocks; }
+    UINT64 Bytes() const { return blocks << shift; }
+    UINT64 OutOfRangeBlocks() const { return outOfRange.size(); }
+
+  private:
+    static const UINT32 LEAF_BITS = 15; // 4 KB leaf = 32768 blocks
+    static const UINT32 DIR_BITS = 9;   // 512 entries per directory node
+    static const UINT64 DIR_MASK = (1ULL << DIR_BITS) - 1;
+    static const INT32 LEVELS = 3;
+    static const UINT64 BLOCK_MASK = (1ULL << (LEAF_BITS + LEVELS * DIR_BITS)) - 1;
+
+    UINT64* Leaf(UINT64 leafIndex) {
+        if (leafIndex == lastLeafIndex) {
+            return lastLeaf;
+        }
+        VOID** node = root;
+        for (INT32 level = LEVELS - 1; level > 0; level--) {
+            VOID*& next = node[(leafIndex >> (level * DIR_BITS)) & DIR_MASK];
+            if (next == NULL) {
+                next = calloc(1 << DIR_BITS, sizeof(VOID*));
+            }
+            node = (VOID**) next;
+        }
+        VOID*& leaf = node[leafIndex & DIR_MASK];
+        if (leaf == NULL) {
+            leaf = calloc(1, 1 << (LEAF_BITS - 3));
+        }
+        lastLeafIndex = leafIndex;
+        lastLeaf = (UINT64*) leaf;
+        return lastLeaf;
+    }
+
+    // ORs in the leaves below `node`, whose leaf indices start with `prefix`
+    VOID MergeNode(VOID* const* node, INT32 level, UINT64 prefix) {
+        for (UINT64 i = 0; i < (1 << DIR_BITS); i++) {
+            if (node[i] == NULL) {
+                continue;
+            }
+            UINT64 index = (prefix << DIR_BITS) | i;
+            if (level > 0) {
+                MergeNode((VOID* const*) node[i], level - 1, index);
+                continue;
+            }
+            const UINT64* words = (const UINT64*) node[i];
+            UINT64* leaf = Leaf(index);
+            for (UINT32 w = 0; w < (1 << (LEAF_BITS - 6)); w++) {
+                UINT64 added = words[w] & ~leaf[w];
+                leaf[w] |= added;
+                blocks += __builtin_popcountll(added);
+            }
+        }
+    }
+
+    static VOID Free(VOID** node, INT32 depth) {
+        for (UINT32 i = 0; i < (1 << DIR_BITS); i++) {
+            if (node[i] != NULL) {
+                if (depth < LEVELS - 1) {
+                    Free((VOID**) node[i], depth + 1);
+                }
+                free(node[i]);
+            }
+        }
+    }
+
+    UINT32 shift;
+    UINT64 blocks;
+    UINT64 lastLeafIndex;
+    UINT64* lastLeaf;
+    VOID* root[1 << DIR_BITS];
+    std::unordered_set<UINT64> outOfRange; // blocks above BLOCK_MASK
+
+    FootprintBitmap(const FootprintBitmap&);
+    FootprintBitmap& operator=(const FootprintBitmap&);
+};
+
+#endif
@@ -0,0 +1,604 @@
+#ifndef PREDICTORS_H
+#define PREDICTORS_H
+
+#include <cmath>
+#include <cstdlib>
+#include <tuple>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Branch direction predictors for HW2 as class templates, so each table
+ * size, counter width and history length is a compile-time constant and
+ * every index mask folds into the code.
+ *
+ * A predictor provides
+ *
+ *   BOOL Predict(const BranchContext& branch, const BOOL* predictions);
+ *   VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken);
+ *
+ * (Predict may keep what it looked up for the Update that follows) and a
+ * PredictorSet<P0, P1, ...> runs a list of them on every branch: all
+ * of them predict, in list order, then all of them are updated, then the
+ * shared global history is shifted. `predictions` holds the predictions
+ * made so far for the current branch, so a hybrid names its components by
+ * their position in the list (Tournament<2, 3, ...> chooses between the
+ * third and fourth predictor) and shares their tables instead of keeping
+ * copies. Components must come before the hybrids that use them; DEPENDS
+ * is checked against the position at compile time.
+ */
+struct BranchContext {
+    ADDRINT pc;
+    ADDRINT target;
+    UINT64 history; // global outcomes, newest in bit 0
+};
+
+template <UINT32 Entries>
+struct IndexMask {
+    static_assert(Entries && (Entries & (Entries - 1)) == 0, "table sizes must be powers of two");
+    static const UINT64 VALUE = Entries - 1;
+};
+
+// Smallest slot of 2, 4 or 8 bits that holds a Bits-bit counter without
+// letting it straddle a word
+template <UINT32 Bits>
+struct PackedSlot {
+    static const UINT32 VALUE = Bits <= 2 ? 2 : (Bits <= 4 ? 4 : 8);
+};
+
+// Entries saturating counters of Bits bits, each in a Slot-bit field.
+// Slot 8 keeps one counter per byte; 2 and 4 pack them into 64-bit words
+// (PackedSlot<Bits>::VALUE), a quarter or half the footprint for 2-bit
+// counters at the cost of a shift and mask per access. Counters start at 0
+// (strongly not taken) and predict taken from half way. Update is branch
+// free: the counter moves unless it is already at the end it moves towards.
+//
+// Every predictor built on counter tables takes the slot as an optional
+// last template parameter, e.g. Bimodal<4096, 2, PackedSlot<2>::VALUE>.
+// Bytes are the default: a 512-entry table already sits in L1, where the
+// shift and mask cost more than the smaller footprint saves.
+template <UINT32 Entries, UINT32 Bits, UINT32 Slot = 8>
+class CounterTable {
+  public:
+    static_assert(Bits >= 1 && Bits <= Slot, "a counter must fit its slot");
+    static_assert(Slot == 2 || Slot == 4 || Slot == 8, "slots are 2, 4 or 8 bits");
+    typedef typename std::conditional<Slot == 8, UINT8, UINT64>::type Word;
+    static const UINT32 PER_WORD = sizeof(Word) * 8 / Slot;
+    static const UINT32 MAX = (1 << Bits) - 1;
+
+    BOOL Taken(UINT32 i) const { return (Get(i) >> (Bits - 1)) & 1; }
+    UINT32 Get(UINT32 i) const { return (words[i / PER_WORD] >> Shift(i)) & SLOT_MASK; }
+
+    VOID Update(UINT32 i, BOOL up) {
+        Word& word = words[i / PER_WORD];
+        UINT32 shift = Shift(i);
+        UINT32 counter = (word >> shift) & SLOT_MASK;
+        UINT32 updated = counter + (up & (counter != MAX)) - (!up & (counter != 0));
+        word ^= (Word) ((counter ^ updated) & SLOT_MASK) << shift;
+    }
+
+  private:
+    static const UINT32 SLOT_MASK = (1 << Slot) - 1;
+    static UINT32 Shift(UINT32 i) { return (i % PER_WORD) * Slot; }
+
+    Word words[(Entries + PER_WORD - 1) / PER_WORD] = {0};
+};
+
+struct ComponentPredictor {
+    static const UINT32 DEPENDS = 0; // predictors that must precede this one in the set
+};
+
+// Forward not taken, backward taken
+struct Fnbt : ComponentPredictor {
+    BOOL Predict(const BranchContext& branch, const BOOL* predictions) const { return branch.target <= branch.pc; }
+    VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken) {}
+};
+
+// PHT of Bits-bit counters indexed by the branch address
+template <UINT32 Entries, UINT32 Bits, UINT32 Slot = 8>
+struct Bimodal : ComponentPredictor {
+    CounterTable<Entries, Bits, Slot> pht;
+
+    UINT32 Index(const BranchContext& branch) const { return branch.pc & IndexMask<Entries>::VALUE; }
+    BOOL Predict(const BranchContext& branch, const BOOL* predictions) const { return pht.Taken(Index(branch)); }
+    VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken) { pht.Update(Index(branch), taken); }
+};
+
+// Per-address histories of HistoryBits bits in a BhtEntries-entry table,
+// indexing one shared PHT
+template <UINT32 BhtEntries, UINT32 HistoryBits, UINT32 Bits, UINT32 Slot = 8>
+struct SAg : ComponentPredictor {
+    static_assert(HistoryBits <= 16, "local histories are kept in 16 bits");
+    static const UINT32 PHT_ENTRIES = 1 << HistoryBits;
+    UINT16 bht[BhtEntries] = {0};
+    CounterTable<PHT_ENTRIES, Bits, Slot> pht;
+
+    UINT32 BhtIndex(const BranchContext& branch) const { return branch.pc & IndexMask<BhtEntries>::VALUE; }
+    BOOL Predict(const BranchContext& branch, const BOOL* predictions) const { return pht.Taken(bht[BhtIndex(branch)]); }
+    VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken) {
+        UINT16& history = bht[BhtIndex(branch)];
+        pht.Update(history, taken);
+        history = ((history << 1) | taken) & IndexMask<PHT_ENTRIES>::VALUE;
+    }
+};
+
+// PHT indexed by the last HistoryBits global outcomes
+template <UINT32 HistoryBits, UINT32 Bits, UINT32 Slot = 8>
+struct GAg : ComponentPredictor {
+    static const UINT32 ENTRIES = 1 << HistoryBits;
+    CounterTable<ENTRIES, Bits, Slot> pht;
+
+    UINT32 Index(const BranchContext& branch) const { return branch.history & IndexMask<ENTRIES>::VALUE; }
+    BOOL Predict(const BranchContext& branch, const BOOL* predictions) const { return pht.Taken(Index(branch)); }
+    VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken) { pht.Update(Index(branch), taken); }
+};
+
+// PHT indexed by the branch address XOR the last HistoryBits global outcomes
+template <UINT32 HistoryBits, UINT32 Bits, UINT32 Slot = 8>
+struct GShare : ComponentPredictor {
+    static const UINT32 ENTRIES = 1 << HistoryBits;
+    CounterTable<ENTRIES, Bits, Slot> pht;
+
+    UINT32 Index(const BranchContext& branch) const { return (branch.pc ^ branch.history) & IndexMask<ENTRIES>::VALUE; }
+    BOOL Predict(const BranchContext& branch, const BOOL* predictions) const { return pht.Taken(Index(branch)); }
+    VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken) { pht.Update(Index(branch), taken); }
+};
+
+// Trains chooser counter i of a table: it moves towards Second when only
+// First was wrong and back when only Second was wrong
+template <UINT32 First, UINT32 Second, typename Table>
+inline VOID TrainChooser(Table& counters, UINT32 i, const BOOL* predictions, BOOL taken) {
+    BOOL firstWrong = predictions[First] != taken;
+    BOOL secondWrong = predictions[Second] != taken;
+    if (firstWrong != secondWrong) {
+        counters.Update(i, firstWrong);
+    }
+}
+
+// Smallest power of two greater than N
+template <UINT32 N, UINT32 P = 1, bool Done = (P > N)>
+struct PowerOfTwoAbove {
+    static const UINT32 VALUE = PowerOfTwoAbove<N, P * 2>::VALUE;
+};
+template <UINT32 N, UINT32 P>
+struct PowerOfTwoAbove<N, P, true> {
+    static const UINT32 VALUE = P;
+};
+
+template <UINT32 A, UINT32 B>
+struct MaxIndex {
+    static const UINT32 VALUE = A > B ? A : B;
+};
+
+// Picks one of two components per branch with chooser counters indexed by
+// global history
+template <UINT32 P1, UINT32 P2, UINT32 HistoryBits, UINT32 Bits, UINT32 Slot = 8>
+struct Tournament {
+    static const UINT32 DEPENDS = MaxIndex<P1, P2>::VALUE + 1;
+    static const UINT32 ENTRIES = 1 << HistoryBits;
+    CounterTable<ENTRIES, Bits, Slot> chooser;
+
+    UINT32 Index(const BranchContext& branch) const { return branch.history & IndexMask<ENTRIES>::VALUE; }
+    BOOL Predict(const BranchContext& branch, const BOOL* predictions) const { return predictions[chooser.Taken(Index(branch)) ? P2 : P1]; }
+    VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken) { TrainChooser<P1, P2>(chooser, Index(branch), predictions, taken); }
+};
+
+// Three components with a chooser per pair: P1/P2 first, then P2/P3 or
+// P3/P1 depending on which of P1 and P2 it picked. The three counters for
+// one history sit side by side in a row, so a branch touches one cache line
+// of chooser state rather than one in each of three tables.
+template <UINT32 P1, UINT32 P2, UINT32 P3, UINT32 HistoryBits, UINT32 Bits, UINT32 Slot = 8>
+struct Tournament3 {
+    static const UINT32 DEPENDS = MaxIndex<MaxIndex<P1, P2>::VALUE, P3>::VALUE + 1;
+    static const UINT32 ENTRIES = 1 << HistoryBits;
+    static const UINT32 ROW = 4; // P1/P2, P2/P3, P3/P1, unused
+    CounterTable<ENTRIES * ROW, Bits, Slot> choosers;
+
+    UINT32 Row(const BranchContext& branch) const { return (branch.history & IndexMask<ENTRIES>::VALUE) * ROW; }
+    BOOL Predict(const BranchContext& branch, const BOOL* predictions) const {
+        UINT32 row = Row(branch);
+        if (choosers.Taken(row)) {
+            return predictions[choosers.Taken(row + 1) ? P3 : P2];
+        }
+        return predictions[choosers.Taken(row + 2) ? P1 : P3];
+    }
+    VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken) {
+        UINT32 row = Row(branch);
+        TrainChooser<P1, P2>(choosers, row, predictions, taken);
+        TrainChooser<P2, P3>(choosers, row + 1, predictions, taken);
+        TrainChooser<P3, P1>(choosers, row + 2, predictions, taken);
+    }
+};
+
+// Majority vote of three components
+template <UINT32 P1, UINT32 P2, UINT32 P3>
+struct Majority {
+    static const UINT32 DEPENDS = MaxIndex<MaxIndex<P1, P2>::VALUE, P3>::VALUE + 1;
+
+    BOOL Predict(const BranchContext& branch, const BOOL* predictions) const { return predictions[P1] + predictions[P2] + predictions[P3] >= 2; }
+    VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken) {}
+};
+
+/*
+ * TAGE: a bimodal base predictor and NumTables tagged tables of
+ * 2^LogTable entries, table i indexed and tagged with a hash of the branch
+ * address and the last L(i) outcomes. The lengths grow geometrically from
+ * MinHistory to MaxHistory, which can be far longer than the 64 bits of the
+ * shared history, so TAGE keeps its own. Each table's hashes come from
+ * folded history registers updated in constant time per branch, whatever
+ * the history length.
+ *
+ * The prediction comes from the hitting table with the longest history
+ * (the provider), or from the next hit (the alternate) while the provider
+ * is a fresh, weak entry and the alternate has lately been the better of
+ * the two. A misprediction allocates an entry in one longer table whose
+ * usefulness counter is 0, or ages the candidates when all are useful;
+ * usefulness counts the times the provider was right where the alternate
+ * was wrong, and is halved every 2^18 branches so stale entries can be
+ * replaced.
+ *
+ * The storage budget is set by the parameters: STORAGE_BITS counts the
+ * modelled state (base counters plus 3-bit counter, tag and 2-bit
+ * usefulness per tagged entry), not the host memory used to hold it.
+ */
+template <UINT32 LogBase, UINT32 NumTables, UINT32 LogTable, UINT32 TagBits, UINT32 MinHistory, UINT32 MaxHistory, UINT32 Slot = 8>
+class Tage : public ComponentPredictor {
+  public:
+    static_assert(NumTables >= 2 && NumTables <= 32, "TAGE has 2 to 32 tagged tables");
+    static_assert(LogTable >= 1 && LogTable <= 16 && TagBits >= 2 && TagBits <= 16, "tables and tags are at most 16 bits");
+    static_assert(MinHistory >= 1 && MinHistory < MaxHistory, "history lengths must grow");
+    static const UINT32 ENTRIES = 1 << LogTable;
+    static const UINT64 STORAGE_BITS = 2ULL * (1 << LogBase) + (UINT64) NumTables * ENTRIES * (3 + TagBits + 2);
+
+    Tage() : useAltOnNew(0), branches(0), random(0x2545F491), head(0) {
+        for (UINT32 i = 0; i < NumTables; i++) {
+            lengths[i] = (UINT32) (MinHistory * pow((double) MaxHistory / MinHistory, (double) i / (NumTables - 1)) + 0.5);
+            index[i].Init(lengths[i], LogTable);
+            tag[i].Init(lengths[i], TagBits);
+            tagShifted[i].Init(lengths[i], TagBits - 1);
+        }
+    }
+
+    UINT32 HistoryLength(UINT32 table) const { return lengths[table]; }
+
+    // Also keeps the lookup for the Update that follows
+    BOOL Predict(const BranchContext& branch, const BOOL* predictions) {
+        UINT32 hits = 0;
+        for (UINT32 i = 0; i < NumTables; i++) {
+            lookup.slots[i] = Index(branch.pc, i);
+            lookup.tags[i] = Tag(branch.pc, i);
+            hits |= (UINT32) (tables[i][lookup.slots[i]].tag == lookup.tags[i]) << i;
+        }
+        lookup.provider = Highest(hits);
+        lookup.alternate = lookup.provider < NumTables ? Highest(hits & ~(1U << lookup.provider)) : NumTables;
+        lookup.basePrediction = base.Taken(BaseIndex(branch.pc));
+        lookup.alternatePrediction = lookup.alternate < NumTables ? tables[lookup.alternate][lookup.slots[lookup.alternate]].ctr >= 0 : lookup.basePrediction;
+        if (lookup.provider == NumTables) {
+            lookup.providerPrediction = lookup.prediction = lookup.basePrediction;
+            return lookup.prediction;
+        }
+        const TaggedEntry& entry = tables[lookup.provider][lookup.slots[lookup.provider]];
+        lookup.providerPrediction = entry.ctr >= 0;
+        lookup.fresh = entry.u == 0 && (entry.ctr == 0 || entry.ctr == -1);
+        lookup.prediction = (lookup.fresh && useAltOnNew >= 0) ? lookup.alternatePrediction : lookup.providerPrediction;
+        return lookup.prediction;
+    }
+
+    VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken) {
+        UINT32 provider = lookup.provider;
+        if (provider < NumTables) {
+            TaggedEntry& entry = tables[provider][lookup.slots[provider]];
+            if (lookup.fresh && lookup.providerPrediction != lookup.alternatePrediction) {
+                Saturate(useAltOnNew, lookup.alternatePrediction == taken, -8, 7);
+            }
+            Saturate(entry.ctr, taken, -4, 3);
+            if (lookup.providerPrediction != lookup.alternatePrediction) {
+                Saturate(entry.u, lookup.providerPrediction == taken, 0, 3);
+            }
+        } else {
+            base.Update(BaseIndex(branch.pc), taken);
+        }
+        if (lookup.prediction != taken && (provider == NumTables || provider + 1 < NumTables)) {
+            Allocate(provider == NumTables ? 0 : provider + 1, taken);
+        }
+        if ((++branches & (AGING_PERIOD - 1)) == 0) {
+            for (UINT32 i = 0; i < NumTables; i++) {
+                for (UINT32 j = 0; j < ENTRIES; j++) {
+                    tables[i][j].u >>= 1;
+                }
+            }
+        }
+        PushHistory(taken);
+    }
+
+  private:
+    static const UINT32 AGING_PERIOD = 1 << 18;
+    static const UINT32 BUFFER = PowerOfTwoAbove<MaxHistory>::VALUE;
+
+    struct TaggedEntry {
+        INT8 ctr;  // 3-bit signed, taken when >= 0
+        UINT8 u;   // 2-bit usefulness
+        UINT16 tag;
+        TaggedEntry() : ctr(0), u(0), tag(0) {}
+    };
+
+    // The last `length` outcomes XOR-folded into `width` bits. Each new
+    // outcome shifts in at bit 0 and the one leaving the window is removed
+    // where it has been rotated to.
+    struct FoldedHistory {
+        UINT32 value;
+        UINT32 width;
+        UINT32 outPosition; // where the oldest outcome has been rotated to
+        VOID Init(UINT32 historyLength, UINT32 bits) {
+            value = 0;
+            width = bits;
+            outPosition = historyLength % bits;
+        }
+        VOID Push(UINT32 in, UINT32 out) {
+            value = (value << 1) | in;
+            value ^= out << outPosition;
+            value ^= value >> width;
+            value &= (1 << width) - 1;
+        }
+    };
+
+    struct Lookup {
+        UINT32 slots[NumTables];
+        UINT16 tags[NumTables];
+        UINT32 provider; // NumTables when no table hit
+        UINT32 alternate;
+        BOOL fresh;
+        BOOL basePrediction;
+        BOOL providerPrediction;
+        BOOL alternatePrediction;
+        BOOL prediction;
+    };
+
+    template <typename T>
+    static VOID Saturate(T& counter, BOOL up, INT32 min, INT32 max) {
+        if (up && counter < max) {
+            counter++;
+        } else if (!up && counter > min) {
+            counter--;
+        }
+    }
+
+    // Highest set bit of a table mask, NumTables when there is none
+    static UINT32 Highest(UINT32 mask) { return mask ? 31 - __builtin_clz(mask) : NumTables; }
+
+    static UINT32 BaseIndex(ADDRINT pc) { return pc & IndexMask<(1 << LogBase)>::VALUE; }
+    UINT32 Index(ADDRINT pc, UINT32 i) const { return (pc ^ (pc >> (LogTable - i % LogTable)) ^ index[i].value) & IndexMask<ENTRIES>::VALUE; }
+    UINT16 Tag(ADDRINT pc, UINT32 i) const { return (pc ^ tag[i].value ^ (tagShifted[i].value << 1)) & ((1 << TagBits) - 1); }
+
+    // One new entry in the first table from `first` on with a useless entry,
+    // skipping it half the time so allocations spread over longer tables
+    VOID Allocate(UINT32 first, BOOL taken) {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        if ((random & 1) && first + 1 < NumTables && tables[first + 1][lookup.slots[first + 1]].u == 0) {
+            first++;
+        }
+        for (UINT32 i = first; i < NumTables; i++) {
+            TaggedEntry& entry = tables[i][lookup.slots[i]];
+            if (entry.u == 0) {
+                entry.tag = lookup.tags[i];
+                entry.ctr = taken ? 0 : -1;
+                return;
+            }
+        }
+        for (UINT32 i = first; i < NumTables; i++) {
+            tables[i][lookup.slots[i]].u--;
+        }
+    }
+
+    VOID PushHistory(BOOL taken) {
+        head = (head - 1) & (BUFFER - 1);
+        history[head] = taken;
+        for (UINT32 i = 0; i < NumTables; i++) {
+            UINT32 out = history[(head + lengths[i]) & (BUFFER - 1)];
+            index[i].Push(taken, out);
+            tag[i].Push(taken, out);
+            tagShifted[i].Push(taken, out);
+        }
+    }
+
+    CounterTable<1 << LogBase, 2, Slot> base;
+    TaggedEntry tables[NumTables][ENTRIES];
+    UINT32 lengths[NumTables];
+    FoldedHistory index[NumTables];
+    FoldedHistory tag[NumTables];
+    FoldedHistory tagShifted[NumTables];
+    Lookup lookup;
+    INT8 useAltOnNew; // >= 0: trust the alternate over a fresh provider
+    UINT64 branches;
+    UINT32 random;
+    UINT8 history[BUFFER] = {0}; // circular, newest outcome at head
+    UINT32 head;
+};
+
+/*
+ * Perceptron predictor over the last HistoryLength global outcomes, with
+ * 2^LogRows rows of int8 weights selected by a hash of the branch address.
+ * The output is the row's bias plus the sum of its weights, each negated
+ * where the matching outcome was not taken; it predicts taken when the sum
+ * is not negative. The row is trained when it mispredicts or the sum is
+ * within THETA of zero, moving every weight towards agreement with the
+ * outcome and saturating at +-127.
+ *
+ * The outcomes are kept as a byte mask (0 taken, -1 not taken) in a window
+ * that is always contiguous, so a row is combined with the history 32 or 16
+ * bytes at a time: with AVX2 when the tool is built with -mavx2, otherwise
+ * with SSE2, which every x86-64 compiler enables, and with a plain loop on
+ * other targets. With a mask m, w * x is (w ^ m) - m and the training step
+ * is (m ^ outcome) | 1, both the same on every path.
+ */
+template <UINT32 LogRows, UINT32 HistoryLength>
+class Perceptron : public ComponentPredictor {
+  public:
+    static_assert(HistoryLength >= 32 && HistoryLength <= 1024 && HistoryLength % 32 == 0, "history length must be a multiple of 32");
+    static const UINT32 ROWS = 1 << LogRows;
+    static const INT32 THETA = (INT32) (1.93 * HistoryLength + 14);
+    static const UINT64 STORAGE_BITS = 8ULL * ROWS * (HistoryLength + 1);
+
+    Perceptron() : position(0) {
+        for (UINT32 i = 0; i < 2 * HistoryLength; i++) {
+            history[i] = -1; // not taken
+        }
+    }
+
+    // Also keeps the output for the Update that follows
+    BOOL Predict(const BranchContext& branch, const BOOL* predictions) {
+        row = branch.pc & IndexMask<ROWS>::VALUE;
+        row ^= (branch.pc >> LogRows) & IndexMask<ROWS>::VALUE;
+        output = bias[row] + Dot(weights[row], history + position);
+        return output >= 0;
+    }
+
+    VOID Update(const BranchContext& branch, const BOOL* predictions, BOOL taken) {
+        if ((output >= 0) != taken || abs(output) <= THETA) {
+            Train(weights[row], history + position, taken);
+            INT32 updated = bias[row] + (taken ? 1 : -1);
+            bias[row] = (INT8) (updated > 127 ? 127 : (updated < -127 ? -127 : updated));
+        }
+        // The window is history[position, position + HistoryLength), newest
+        // first; each outcome is written twice so it stays contiguous
+        position = (position ? position : HistoryLength) - 1;
+        history[position] = history[position + HistoryLength] = taken ? 0 : -1;
+    }
+
+  private:
+#if defined(__AVX2__)
+    static INT32 Dot(const INT8* w, const INT8* m) {
+        __m256i sum = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi16(1);
+        for (UINT32 i = 0; i < HistoryLength; i += 32) {
+            __m256i mask = _mm256_loadu_si256((const __m256i*) (m + i));
+            __m256i product = _mm256_sub_epi8(_mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (w + i)), mask), mask);
+            __m256i low = _mm256_srai_epi16(_mm256_unpacklo_epi8(product, product), 8);
+            __m256i high = _mm256_srai_epi16(_mm256_unpackhi_epi8(product, product), 8);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_add_epi16(low, high), ones));
+        }
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(half);
+    }
+
+    static VOID Train(INT8* w, const INT8* m, BOOL taken) {
+        const __m256i outcome = _mm256_set1_epi8(taken ? 0 : -1);
+        const __m256i one = _mm256_set1_epi8(1);
+        const __m256i floor = _mm256_set1_epi8(-128);
+        for (UINT32 i = 0; i < HistoryLength; i += 32) {
+            __m256i mask = _mm256_loadu_si256((const __m256i*) (m + i));
+            __m256i step = _mm256_or_si256(_mm256_xor_si256(mask, outcome), one);
+            __m256i updated = _mm256_adds_epi8(_mm256_loadu_si256((const __m256i*) (w + i)), step);
+            updated = _mm256_sub_epi8(updated, _mm256_cmpeq_epi8(updated, floor)); // -128 -> -127
+            _mm256_storeu_si256((__m256i*) (w + i), updated);
+        }
+    }
+#elif defined(__SSE2__)
+    static INT32 Dot(const INT8* w, const INT8* m) {
+        __m128i sum = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+        for (UINT32 i = 0; i < HistoryLength; i += 16) {
+            __m128i mask = _mm_loadu_si128((const __m128i*) (m + i));
+            __m128i product = _mm_sub_epi8(_mm_xor_si128(_mm_loadu_si128((const __m128i*) (w + i)), mask), mask);
+            __m128i low = _mm_srai_epi16(_mm_unpacklo_epi8(product, product), 8);
+            __m128i high = _mm_srai_epi16(_mm_unpackhi_epi8(product, product), 8);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_add_epi16(low, high), ones));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(sum);
+    }
+
+    static VOID Train(INT8* w, const INT8* m, BOOL taken) {
+        const __m128i outcome = _mm_set1_epi8(taken ? 0 : -1);
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i floor = _mm_set1_epi8(-128);
+        for (UINT32 i = 0; i < HistoryLength; i += 16) {
+            __m128i mask = _mm_loadu_si128((const __m128i*) (m + i));
+            __m128i step = _mm_or_si128(_mm_xor_si128(mask, outcome), one);
+            __m128i updated = _mm_adds_epi8(_mm_loadu_si128((const __m128i*) (w + i)), step);
+            updated = _mm_sub_epi8(updated, _mm_cmpeq_epi8(updated, floor)); // -128 -> -127
+            _mm_storeu_si128((__m128i*) (w + i), updated);
+        }
+    }
+#else
+    static INT32 Dot(const INT8* w, const INT8* m) {
+        INT32 sum = 0;
+        for (UINT32 i = 0; i < HistoryLength; i++) {
+            sum += (w[i] ^ m[i]) - m[i];
+        }
+        return sum;
+    }
+
+    static VOID Train(INT8* w, const INT8* m, BOOL taken) {
+        INT8 outcome = taken ? 0 : -1;
+        for (UINT32 i = 0; i < HistoryLength; i++) {
+            INT32 updated = w[i] + ((m[i] ^ outcome) | 1);
+            w[i] = (INT8) (updated > 127 ? 127 : (updated < -127 ? -127 : updated));
+        }
+    }
+#endif
+
+    INT8 weights[ROWS][HistoryLength] = {{0}};
+    INT8 bias[ROWS] = {0};
+    INT8 history[2 * HistoryLength]; // outcome masks, see Update
+    UINT32 position;
+    UINT32 row;   // from the last Predict
+    INT32 output;
+};
+
+template <typename... Predictors>
+class PredictorSet {
+  public:
+    static const UINT32 SIZE = sizeof...(Predictors);
+
+    PredictorSet() : history(0) {}
+
+    // Predicts and trains every predictor on one branch; mispredicted[i] is
+    // set when predictor i was wrong
+    VOID Access(ADDRINT pc, ADDRINT target, BOOL taken, BOOL* mispredicted) {
+        BranchContext branch = {pc, target, history};
+        BOOL predictions[SIZE];
+        PredictAll(branch, predictions, std::integral_constant<UINT32, 0>());
+        UpdateAll(branch, predictions, taken, std::integral_constant<UINT32, 0>());
+        history = (history << 1) | taken;
+        for (UINT32 i = 0; i < SIZE; i++) {
+            mispredicted[i] = predictions[i] != taken;
+        }
+    }
+
+    UINT64 History() const { return history; }
+
+    template <UINT32 I>
+    typename std::tuple_element<I, std::tuple<Predictors...> >::type& Get() {
+        return std::get<I>(predictors);
+    }
+
+  private:
+    template <UINT32 I>
+    VOID PredictAll(const BranchContext& branch, BOOL* predictions, std::integral_constant<UINT32, I>) {
+        typedef typename std::tuple_element<I, std::tuple<Predictors...> >::type Predictor;
+        static_assert(Predictor::DEPENDS <= I, "a hybrid must come after its components");
+        predictions[I] = std::get<I>(predictors).Predict(branch, predictions);
+        PredictAll(branch, predictions, std::integral_constant<UINT32, I + 1>());
+    }
+    VOID PredictAll(const BranchContext& branch, BOOL* predictions, std::integral_constant<UINT32, SIZE>) {}
+
+    template <UINT32 I>
+    VOID UpdateAll(const BranchContext& branch, const BOOL* predictions, BOOL taken, std::integral_constant<UINT32, I>) {
+        std::get<I>(predictors).Update(branch, predictions, taken);
+        UpdateAll(branch, predictions, taken, std::integral_constant<UINT32, I + 1>());
+    }
+    VOID UpdateAll(const BranchContext& branch, const BOOL* predictions, BOOL taken, std::integral_constant<UINT32, SIZE>) {}
+
+    std::tuple<Predictors...> predictors;
+    UINT64 history;
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <cctype>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Machine-readable results for HW1 and HW2 (-format json|csv) and the
+ * periodic snapshots written while the application runs (-snapshot N).
+ *
+ * A MetricReport is a flat list of (group, name, value) in the order the
+ * metrics were added. JSON output is one object per line, so window reports
+ * and snapshots can share a file:
+ *
+ *   {"kind":"window","window":0,"metrics":{"cache":{"l1d_misses":42,...},...}}
+ *
+ * CSV output is one row per metric, kind,window,group,name,value, under the
+ * header written by WriteCsvHeader. Metrics of a group must be added
+ * together.
+ */
+enum ReportFormat {
+    REPORT_TEXT,
+    REPORT_JSON,
+    REPORT_CSV
+};
+
+inline BOOL ParseReportFormat(const std::string& name, ReportFormat& format) {
+    if (name == "text") {
+        format = REPORT_TEXT;
+    } else if (name == "json") {
+        format = REPORT_JSON;
+    } else if (name == "csv") {
+        format = REPORT_CSV;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// "Conditional Branches" -> "conditional_branches"
+inline std::string MetricName(const std::string& text) {
+    std::string name;
+    for (char c : text) {
+        if (isalnum((unsigned char) c)) {
+            name += (char) tolower((unsigned char) c);
+        } else if (!name.empty() && name[name.size() - 1] != '_') {
+            name += '_';
+        }
+    }
+    while (!name.empty() && name[name.size() - 1] == '_') {
+        name.erase(name.size() - 1);
+    }
+    return name;
+}
+
+class MetricReport {
+  public:
+    MetricReport(const std::string& kind, UINT32 window) : kind(kind), window(window) {}
+
+    VOID Add(const std::string& group, const std::string& name, UINT64 value) { Append(group, name, ToString(value), false); }
+    VOID Add(const std::string& group, const std::string& name, INT64 value) { Append(group, name, ToString(value), false); }
+    VOID Add(const std::string& group, const std::string& name, UINT32 value) { Append(group, name, ToString(value), false); }
+    VOID Add(const std::string& group, const std::string& name, INT32 value) { Append(group, name, ToString(value), false); }
+    VOID Add(const std::string& group, const std::string& name, const std::string& value) { Append(group, name, value, true); }
+    VOID Add(const std::string& group, const std::string& name, double value) {
+        if (std::isfinite(value)) {
+            std::ostringstream text;
+            text << std::setprecision(10) << value;
+            Append(group, name, text.str(), false);
+        } else {
+            Append(group, name, "null", false); // e.g. a rate over an empty window
+        }
+    }
+
+    static VOID WriteCsvHeader(std::ostream& out) { out << "kind,window,group,name,value" << std::endl; }
+
+    VOID Write(std::ostream& out, ReportFormat format) const {
+        if (format == REPORT_JSON) {
+            WriteJson(out);
+        } else if (format == REPORT_CSV) {
+            WriteCsv(out);
+        } else {
+            WriteText(out);
+        }
+        out.flush();
+    }
+
+  private:
+    struct Metric {
+        std::string group;
+        std::string name;
+        std::string value;
+        BOOL quoted;
+    };
+
+    template <typename T>
+    static std::string ToString(T value) {
+        std::ostringstream text;
+        text << value;
+        return text.str();
+    }
+
+    VOID Append(const std::string& group, const std::string& name, const std::string& value, BOOL quoted) {
+        Metric metric = {group, name, value, quoted};
+        metrics.push_back(metric);
+    }
+
+    static std::string JsonString(const std::string& text) {
+        std::ostringstream quoted;
+        quoted << '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                quoted << '\\' << c;
+            } else if ((unsigned char) c < 0x20) {
+                quoted << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) c << std::dec;
+            } else {
+                quoted << c;
+            }
+        }
+        quoted << '"';
+        return quoted.str();
+    }
+
+    static std::string CsvField(const std::string& text) {
+        if (text.find_first_of(",\"\n") == std::string::npos) {
+            return text;
+        }
+        std::string quoted = "\"";
+        for (char c : text) {
+            quoted += c;
+            if (c == '"') {
+                quoted += '"';
+            }
+        }
+        return quoted + "\"";
+    }
+
+    VOID WriteJson(std::ostream& out) const {
+        out << "{\"kind\":" << JsonString(kind) << ",\"window\":" << window << ",\"metrics\":{";
+        for (size_t i = 0; i < metrics.size(); i++) {
+            const Metric& metric = metrics[i];
+            BOOL newGroup = (i == 0 || metrics[i - 1].group != metric.group);
+            if (newGroup) {
+                out << (i ? "}," : "") << JsonString(metric.group) << ":{";
+            } else {
+                out << ",";
+            }
+            out << JsonString(metric.name) << ":" << (metric.quoted ? JsonString(metric.value) : metric.value);
+        }
+        out << (metrics.empty() ? "" : "}") << "}}" << std::endl;
+    }
+
+    VOID WriteCsv(std::ostream& out) const {
+        for (const Metric& metric : metrics) {
+            out << kind << "," << window << "," << metric.group << "," << metric.name << ","
+                << (metric.quoted ? CsvField(metric.value) : metric.value) << std::endl;
+        }
+    }
+
+    VOID WriteText(std::ostream& out) const {
+        out << "[" << kind << " " << window << "]";
+        for (size_t i = 0; i < metrics.size(); i++) {
+            if (i == 0 || metrics[i - 1].group != metrics[i].group) {
+                out << (i ? "; " : " ") << metrics[i].group << ": ";
+            } else {
+                out << ", ";
+            }
+            out << metrics[i].name << " " << metrics[i].value;
+        }
+        out << std::endl;
+    }
+
+    std::string kind;
+    UINT32 window;
+    std::vector<Metric> metrics;
+};
+
+/*
+ * Calls `snapshot` from a Pin internal thread each time `progress` (the
+ * number of instructions executed so far) passes another multiple of the
+ * interval. The internal thread polls, so application threads never wait
+ * for a snapshot to be formatted; snapshots only read counters, which may
+ * be slightly out of date. Stop must be called from a PrepareForFini
+ * callback, as Pin requires internal threads to have exited before Fini.
+ */
+class SnapshotThread {
+  public:
+    typedef UINT64 (*ProgressFunction)();
+    typedef VOID (*SnapshotFunction)(UINT32 index, UINT64 instructions, UINT64 seconds);
+
+    SnapshotThread() : interval(0), progress(NULL), snapshot(NULL), start(0), stop(false), uid(INVALID_PIN_THREAD_UID) {}
+
+    BOOL Start(UINT64 instructions, ProgressFunction progressFunction, SnapshotFunction snapshotFunction) {
+        interval = instructions;
+        progress = progressFunction;
+        snapshot = snapshotFunction;
+        start = time(NULL);
+        return PIN_SpawnInternalThread(Run, this, 0, &uid) != INVALID_THREADID;
+    }
+
+    VOID Stop() {
+        if (uid != INVALID_PIN_THREAD_UID && !stop) {
+            stop = true;
+            PIN_WaitForThreadTermination(uid, PIN_INFINITE_TIMEOUT, NULL);
+        }
+    }
+
+  private:
+    static const UINT32 POLL_MS = 100;
+
+    static VOID Run(VOID* arg) {
+        SnapshotThread* self = static_cast<SnapshotThread*>(arg);
+        UINT64 next = self->interval;
+        for (UINT32 index = 0; !self->stop && !PIN_IsProcessExiting();) {
+            PIN_Sleep(POLL_MS);
+            UINT64 instructions = self->progress();
+            if (instructions >= next) {
+                self->snapshot(index++, instructions, time(NULL) - self->start);
+                next = (instructions / self->interval + 1) * self->interval;
+            }
+        }
+    }
+
+    UINT64 interval;
+    ProgressFunction progress;
+    SnapshotFunction snapshot;
+    time_t start;
+    volatile BOOL stop;
+    PIN_THREAD_UID uid;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef REUSE_H
+#define REUSE_H
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * LRU stack (reuse) distance of a block stream: the number of distinct other
+ * blocks touched since the previous access to the same block.
+ *
+ * Every access gets a logical timestamp, and a Fenwick tree over timestamps
+ * holds a 1 at the most recent access of each block. The distance is then the
+ * count of ones strictly between the previous and the current access, which
+ * is O(log n). When the timestamps run out the live ones are renumbered
+ * densely, so the tree stays proportional to the number of distinct blocks.
+ *
+ * Distances are binned by powers of two: bin 0 holds distance 0 and bin k
+ * holds [2^(k-1), 2^k). A fully associative LRU cache of 2^k blocks misses
+ * exactly on cold accesses and on distances in bins k + 1 and up.
+ */
+class ReuseDistance {
+  public:
+    static const UINT32 BINS = 64;
+
+    ReuseDistance() : now(0), accesses(0), coldMisses(0) {
+        tree.assign(INITIAL_CAPACITY + 1, 0);
+        std::fill(histogram, histogram + BINS, 0);
+    }
+
+    VOID Access(UINT64 block) {
+        if (now + 1 >= tree.size()) {
+            Compact();
+        }
+        accesses++;
+        std::pair<std::unordered_map<UINT64, UINT64>::iterator, bool> result = lastAccess.insert(std::make_pair(block, now));
+        if (result.second) {
+            coldMisses++;
+        } else {
+            UINT64 last = result.first->second;
+            UINT64 distance = Prefix(now) - Prefix(last + 1);
+            histogram[Bin(distance)]++;
+            Add(last, -1);
+            result.first->second = now;
+        }
+        Add(now, 1);
+        now++;
+    }
+
+    UINT64 Accesses() const { return accesses; }
+    UINT64 ColdMisses() const { return coldMisses; }
+    UINT64 Histogram(UINT32 bin) const { return histogram[bin]; }
+
+    // Adds the histogram of another stream, for totals over several
+    VOID AddCounts(const ReuseDistance& other) {
+        accesses += other.accesses;
+        coldMisses += other.coldMisses;
+        for (UINT32 bin = 0; bin < BINS; bin++) {
+            histogram[bin] += other.histogram[bin];
+        }
+    }
+
+    // Misses of a fully associative LRU cache holding 2^sizeLog blocks
+    UINT64 Misses(UINT32 sizeLog) const {
+        UINT64 misses = coldMisses;
+        for (UINT32 bin = sizeLog + 1; bin < BINS; bin++) {
+            misses += histogram[bin];
+        }
+        return misses;
+    }
+
+    static UINT32 Bin(UINT64 distance) {
+        UINT32 bin = 0;
+        while (distance) {
+            distance >>= 1;
+            bin++;
+        }
+        return bin;
+    }
+
+  private:
+    static const UINT64 INITIAL_CAPACITY = 1 << 16; // kept small, there is one tree per thread
+
+    // Sum of the marks at timestamps [0, time)
+    INT64 Prefix(UINT64 time) const {
+        INT64 sum = 0;
+        for (UINT64 i = time; i > 0; i -= i & (~i + 1)) {
+            sum += tree[i];
+        }
+        return sum;
+    }
+
+    VOID Add(UINT64 time, INT32 delta) {
+        for (UINT64 i = time + 1; i < tree.size(); i += i & (~i + 1)) {
+            tree[i] += delta;
+        }
+    }
+
+    // Renumbers the live timestamps 0..n-1 in order and rebuilds the tree
+    VOID Compact() {
+        std::vector<std::pair<UINT64, UINT64> > live;
+        live.reserve(lastAccess.size());
+        for (std::unordered_map<UINT64, UINT64>::const_iterator it = lastAccess.begin(); it != lastAccess.end(); ++it) {
+            live.push_back(std::make_pair(it->second, it->first));
+        }
+        std::sort(live.begin(), live.end());
+        for (UINT64 i = 0; i < live.size(); i++) {
+            lastAccess[live[i].second] = i;
+        }
+        now = live.size();
+
+        tree.assign(std::max<UINT64>(2 * now, INITIAL_CAPACITY) + 1, 0);
+        for (UINT64 i = 1; i < tree.size(); i++) {
+            tree[i] += (i <= now) ? 1 : 0;
+            UINT64 parent = i + (i & (~i + 1));
+            if (parent < tree.size()) {
+                tree[parent] += tree[i];
+            }
+        }
+    }
+
+    UINT64 now;
+    UINT64 accesses;
+    UINT64 coldMisses;
+    UINT64 histogram[BINS];
+    std::vector<INT32> tree;
+    std::unordered_map<UINT64, UINT64> lastAccess;
+
+    ReuseDistance(const ReuseDistance&);
+    ReuseDistance& operator=(const ReuseDistance&);
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef SIMPOINT_H
+#define SIMPOINT_H
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Sparse basic block vector: (block id, instructions executed in the block)
+typedef std::vector<std::pair<UINT32, UINT64> > BasicBlockVector;
+
+/*
+ * SimPoint-style phase clustering of basic block vectors.
+ *
+ * Each interval's vector is normalised to sum to one and randomly projected
+ * down to a few dimensions; the projection matrix is a hash of (block id,
+ * dimension), so nothing is stored per block. k-means is then run for every
+ * k up to maxK (best of several k-means++ seeds each), k is chosen with the
+ * Bayesian Information Criterion as in SimPoint, and the interval nearest to
+ * each centroid becomes that phase's simulation point.
+ */
+class SimPointClustering {
+  public:
+    struct SimPoint {
+        UINT32 interval;
+        UINT32 cluster;
+        double weight;
+    };
+
+    explicit SimPointClustering(UINT32 dims = 15, UINT32 seeds = 5) : dims(dims), seeds(seeds) {}
+
+    VOID AddInterval(const BasicBlockVector& bbv) {
+        std::vector<double> point(dims, 0.0);
+        UINT64 total = 0;
+        for (size_t i = 0; i < bbv.size(); i++) {
+            total += bbv[i].second;
+        }
+        for (size_t i = 0; i < bbv.size(); i++) {
+            double value = total ? 1.0 * bbv[i].second / total : 0.0;
+            for (UINT32 d = 0; d < dims; d++) {
+                point[d] += value * Projection(bbv[i].first, d);
+            }
+        }
+        points.push_back(point);
+    }
+
+    UINT32 Intervals() const { return points.size(); }
+
+    // Picks k and returns one simulation point per non-empty cluster
+    std::vector<SimPoint> Cluster(UINT32 maxK) {
+        std::vector<SimPoint> simPoints;
+        if (points.empty()) {
+            return simPoints;
+        }
+        // The BIC is only defined with more intervals than clusters, so k
+        // stops one short of the interval count; a single interval is one
+        // cluster
+        maxK = std::max<UINT32>(std::min<size_t>(maxK, points.size() - 1), 1);
+
+        std::vector<std::vector<UINT32> > assignments(maxK + 1);
+        std::vector<std::vector<std::vector<double> > > centroids(maxK + 1);
+        std::vector<double> bic(maxK + 1, 0.0);
+        double minBic = HUGE_VAL;
+        double maxBic = -HUGE_VAL;
+        for (UINT32 k = 1; k <= maxK; k++) {
+            double best = HUGE_VAL;
+            for (UINT32 seed = 0; seed < seeds; seed++) {
+                std::vector<UINT32> assignment;
+                std::vector<std::vector<double> > centres;
+                double sse = KMeans(k, seed, assignment, centres);
+                if (sse < best) {
+                    best = sse;
+                    assignments[k] = assignment;
+                    centroids[k] = centres;
+                }
+            }
+            if (k < points.size()) {
+                bic[k] = Bic(k, best, assignments[k]);
+                minBic = std::min(minBic, bic[k]);
+                maxBic = std::max(maxBic, bic[k]);
+            }
+        }
+
+        // Smallest k that reaches 90% of the BIC range, as SimPoint does
+        UINT32 k = maxK;
+        for (UINT32 candidate = 1; candidate <= maxK && candidate < points.size(); candidate++) {
+            if (bic[candidate] >= minBic + 0.9 * (maxBic - minBic)) {
+                k = candidate;
+                break;
+            }
+        }
+
+        std::vector<UINT32> sizes(k, 0);
+        std::vector<UINT32> nearest(k, 0);
+        std::vector<double> nearestDistance(k, HUGE_VAL);
+        for (UINT32 p = 0; p < points.size(); p++) {
+            UINT32 c = assignments[k][p];
+            sizes[c]++;
+            double distance = Distance(points[p], centroids[k][c]);
+            if (distance < nearestDistance[c]) {
+                nearestDistance[c] = distance;
+                nearest[c] = p;
+            }
+        }
+        for (UINT32 c = 0; c < k; c++) {
+            if (sizes[c]) {
+                SimPoint simPoint = {nearest[c], c, 1.0 * sizes[c] / points.size()};
+                simPoints.push_back(simPoint);
+            }
+        }
+        return simPoints;
+    }
+
+  private:
+    static UINT64 Mix(UINT64 x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // Uniform in [-1, 1), fixed for a given (block, dimension)
+    double Projection(UINT32 block, UINT32 d) const {
+        return (Mix(((UINT64) block << 8) | d) >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+    }
+
+    static double Distance(const std::vector<double>& a, const std::vector<double>& b) {
+        double sum = 0.0;
+        for (size_t d = 0; d < a.size(); d++) {
+            sum += (a[d] - b[d]) * (a[d] - b[d]);
+        }
+        return sum;
+    }
+
+    // Lloyd's algorithm from a k-means++ start; returns the sum of squared errors
+    double KMeans(UINT32 k, UINT32 seed, std::vector<UINT32>& assignment, std::vector<std::vector<double> >& centres) const {
+        std::mt19937_64 random(seed * 7919 + k);
+        UINT32 n = points.size();
+        std::vector<double> closest(n, HUGE_VAL);
+
+        centres.assign(1, points[random() % n]);
+        while (centres.size() < k) {
+            double total = 0.0;
+            for (UINT32 p = 0; p < n; p++) {
+                closest[p] = std::min(closest[p], Distance(points[p], centres.back()));
+                total += closest[p];
+            }
+            double target = std::uniform_real_distribution<double>(0.0, total)(random);
+            UINT32 pick = 0;
+            for (; pick < n - 1 && target > closest[pick]; pick++) {
+                target -= closest[pick];
+            }
+            centres.push_back(points[pick]);
+        }
+
+        assignment.assign(n, 0);
+        double sse = 0.0;
+        for (UINT32 iteration = 0; iteration < 100; iteration++) {
+            BOOL changed = false;
+            sse = 0.0;
+            for (UINT32 p = 0; p < n; p++) {
+                UINT32 best = 0;
+                double bestDistance = HUGE_VAL;
+                for (UINT32 c = 0; c < k; c++) {
+                    double distance = Distance(points[p], centres[c]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = c;
+                    }
+                }
+                changed |= (assignment[p] != best) || iteration == 0;
+                assignment[p] = best;
+                sse += bestDistance;
+            }
+            if (!changed) {
+                break;
+            }
+            std::vector<std::vector<double> > sums(k, std::vector<double>(dims, 0.0));
+            std::vector<UINT32> sizes(k, 0);
+            for (UINT32 p = 0; p < n; p++) {
+                sizes[assignment[p]]++;
+                for (UINT32 d = 0; d < dims; d++) {
+                    sums[assignment[p]][d] += points[p][d];
+                }
+            }
+            for (UINT32 c = 0; c < k; c++) {
+                for (UINT32 d = 0; sizes[c] && d < dims; d++) {
+                    centres[c][d] = sums[c][d] / sizes[c];
+                }
+            }
+        }
+        return sse;
+    }
+
+    // Pelleg and Moore's BIC for a spherical Gaussian mixture; needs k < r
+    double Bic(UINT32 k, double sse, const std::vector<UINT32>& assignment) const {
+        double r = points.size();
+        double variance = std::max(sse / (r - k), 1e-300);
+        std::vector<UINT32> sizes(k, 0);
+        for (size_t p = 0; p < assignment.size(); p++) {
+            sizes[assignment[p]]++;
+        }
+        double likelihood = 0.0;
+        for (UINT32 c = 0; c < k; c++) {
+            double rc = sizes[c];
+            if (rc == 0) {
+                continue;
+            }
+            likelihood += -rc / 2 * std::log(2 * M_PI) - rc * dims / 2 * std::log(variance)
+                          - (rc - k) / 2 + rc * std::log(rc) - rc * std::log(r);
+        }
+        double parameters = (k - 1) + dims * k + 1;
+        return likelihood - parameters / 2 * std::log(r);
+    }
+
+    UINT32 dims;
+    UINT32 seeds;
+    std::vector<std::vector<double> > points;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include "cache.h"
+
+struct TlbGeometry {
+    UINT32 entries;
+    UINT32 assoc;
+};
+
+/*
+ * Address translation for one page size: split first-level instruction and
+ * data TLBs backed by a shared second-level TLB (STLB). Each level is a
+ * Cache over virtual page numbers. A first-level hit is free, an STLB hit
+ * costs stlbLatency cycles, and an STLB miss adds a page walk of
+ * walkLatency cycles; the page-table accesses themselves are not sent
+ * through the data caches.
+ */
+class TlbHierarchy {
+  public:
+    TlbHierarchy(UINT32 pageShift, TlbGeometry itlbGeometry, TlbGeometry dtlbGeometry, TlbGeometry stlbGeometry, UINT32 stlbLatency,
+                 UINT32 walkLatency)
+        : pageShift(pageShift), itlb(NewLevel(itlbGeometry, 0)), dtlb(NewLevel(dtlbGeometry, 0)), stlb(NewLevel(stlbGeometry, stlbLatency)),
+          walkLatency(walkLatency), walks(0), cycles(0) {}
+
+    ~TlbHierarchy() {
+        delete itlb;
+        delete dtlb;
+        delete stlb;
+    }
+
+    static BOOL ValidGeometry(TlbGeometry geometry) { return Cache::ValidGeometry(geometry.entries, geometry.assoc, 0); }
+
+    // Translates every page of [address, address + size); returns the cycles spent
+    UINT32 Access(BOOL instruction, ADDRINT address, UINT32 size) {
+        Cache* l1 = instruction ? itlb : dtlb;
+        UINT64 lastPage = (address + (size ? size - 1 : 0)) >> pageShift;
+        UINT32 spent = 0;
+        for (UINT64 page = address >> pageShift; page <= lastPage; page++) {
+            if (l1->Access(page)) {
+                continue;
+            }
+            spent += stlb->Latency();
+            if (!stlb->Access(page)) {
+                walks++;
+                spent += walkLatency;
+            }
+        }
+        cycles += spent;
+        return spent;
+    }
+
+    UINT32 PageShift() const { return pageShift; }
+    const Cache* Itlb() const { return itlb; }
+    const Cache* Dtlb() const { return dtlb; }
+    const Cache* Stlb() const { return stlb; }
+    UINT64 Walks() const { return walks; }
+    UINT64 Cycles() const { return cycles; }
+
+    // Adds the counts of another hierarchy, for totals over several
+    VOID AddCounts(const TlbHierarchy& other) {
+        itlb->AddCounts(*other.itlb);
+        dtlb->AddCounts(*other.dtlb);
+        stlb->AddCounts(*other.stlb);
+        walks += other.walks;
+        cycles += other.cycles;
+    }
+
+  private:
+    TlbHierarchy(const TlbHierarchy&);
+    TlbHierarchy& operator=(const TlbHierarchy&);
+
+    static Cache* NewLevel(TlbGeometry geometry, UINT32 latency) { return new Cache(geometry.entries, geometry.assoc, 0, REPLACE_LRU, latency); }
+
+    UINT32 pageShift;
+    Cache* itlb;
+    Cache* dtlb;
+    Cache* stlb;
+    UINT32 walkLatency;
+    UINT64 walks;
+    UINT64 cycles;
+};
+
+#endif
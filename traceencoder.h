@@ -0,0 +1,269 @@
+#ifndef TRACEENCODER_H
+#define TRACEENCODER_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "traceformat.h"
+
+/*
+ * Encoder side of the trace format in traceformat.h, without Pin, so that
+ * offline tools and tests can write traces too. tracewriter.h feeds it
+ * from the Pin trace buffers.
+ *
+ * Raw entries (block id, effective addresses, branch outcome) are turned
+ * into records, each field appended to its stream. A full block is
+ * compressed into the thread's output file, which is memory-mapped and
+ * grown in large steps so writing it is a copy. A block's entries can
+ * straddle two batches, so the record being built is kept open until the
+ * next block starts.
+ */
+enum TraceEntryKind : uint32_t {
+    TRACE_ENTRY_BBL,
+    TRACE_ENTRY_MEMORY,
+    TRACE_ENTRY_BRANCH
+};
+
+// Filled by Pin: every field is written with the width of its IARG type,
+// so kind (IARG_UINT32) must be a full 32-bit field ahead of taken
+// (IARG_BRANCH_TAKEN, one BOOL), or storing it would clobber the outcome
+struct TraceEntry {
+    uint64_t value; // effective address or branch target
+    uint32_t id;    // block id, or memory operand index within the block
+    uint32_t kind;
+    bool taken;
+};
+
+// One thread's output file
+class TraceFileWriter {
+  public:
+    TraceFileWriter(const std::string& path, uint32_t tid)
+        : fd(open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)), map(NULL), capacity(0), size(0),
+          blockRecords(0), memOps(0), lastBbl(0), pendingBbl(NO_BBL) {
+        for (uint32_t s = 0; s < TRACE_STREAMS; s++) {
+            streams[s].resize(TRACE_BLOCK_BYTES);
+            streamEnd[s] = &streams[s][0];
+        }
+        presentBit = takenBit = 0;
+        payload.resize(sizeof(TraceStreamSizes) + TRACE_BLOCK_BYTES);
+        packed.resize(TraceCompressBound(payload.size()));
+        if (fd >= 0) {
+            TraceFileHeader header;
+            memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+            header.blockBytes = TRACE_BLOCK_BYTES;
+            header.thread = tid;
+            Write(&header, sizeof(header));
+        }
+    }
+
+    bool Valid() const { return fd >= 0; }
+
+    // Picks up the blocks added to `table` since the last call; the caller
+    // holds the lock that guards additions
+    void Sync(const TraceStaticTable& table) {
+        for (uint32_t id = bbls.size(); id < table.Size(); id++) {
+            bbls.push_back(&table[id]);
+        }
+        memOps = table.MemOps();
+    }
+
+    void Append(const TraceEntry* entries, uint64_t numEntries) {
+        for (uint64_t e = 0; e < numEntries; e++) {
+            const TraceEntry& entry = entries[e];
+            switch (entry.kind) {
+            case TRACE_ENTRY_BBL:
+                EncodePending();
+                pendingBbl = entry.id;
+                pendingTaken = false;
+                pendingTarget = 0;
+                std::fill(pendingPresent.begin(), pendingPresent.end(), 0);
+                break;
+            case TRACE_ENTRY_MEMORY:
+                if (entry.id >= pendingAddresses.size()) {
+                    pendingAddresses.resize(entry.id + 1);
+                    pendingPresent.resize(entry.id + 1, 0);
+                }
+                // A REP string instruction repeats without a new block
+                // entry; keep its first address (see traceformat.h)
+                if (!pendingPresent[entry.id]) {
+                    pendingAddresses[entry.id] = entry.value;
+                    pendingPresent[entry.id] = 1;
+                }
+                break;
+            case TRACE_ENTRY_BRANCH:
+                pendingTaken = entry.taken;
+                pendingTarget = entry.value;
+                break;
+            }
+        }
+    }
+
+    void Close() {
+        if (fd < 0) {
+            return;
+        }
+        EncodePending();
+        FlushBlock();
+        munmap(map, capacity);
+        if (ftruncate(fd, size) != 0) {
+            // Leaves zero padding at the end, which readers stop at
+        }
+        close(fd);
+        fd = -1;
+    }
+
+  private:
+    static const uint32_t NO_BBL = ~0U;
+    static const uint64_t GROW_BYTES = 64ULL << 20;
+
+    void EncodePending() {
+        if (pendingBbl == NO_BBL) {
+            return;
+        }
+        const TraceBbl& bbl = *bbls[pendingBbl];
+        uint32_t blockBytes = 0;
+        for (uint32_t s = 0; s < TRACE_STREAMS; s++) {
+            blockBytes += streamEnd[s] - &streams[s][0];
+        }
+        if (blockBytes + TraceRecordBound(bbl) > TRACE_BLOCK_BYTES) {
+            FlushBlock();
+        }
+        if (lastAddress.size() < bbl.firstMemOp + bbl.memOps.size()) {
+            lastAddress.resize(memOps, 0);
+        }
+        if (lastTarget.size() <= pendingBbl) {
+            lastTarget.resize(bbls.size(), 0);
+        }
+        if (pendingPresent.size() < bbl.memOps.size()) {
+            pendingAddresses.resize(bbl.memOps.size());
+            pendingPresent.resize(bbl.memOps.size(), 0);
+        }
+
+        streamEnd[TRACE_STREAM_BBLS] = PutVarint(streamEnd[TRACE_STREAM_BBLS], ZigZag((int64_t) pendingBbl - (int64_t) lastBbl));
+        lastBbl = pendingBbl;
+
+        if (bbl.numPredicated) {
+            for (uint32_t i = 0; i < bbl.memOps.size(); i++) {
+                if (bbl.memOps[i].flags & TRACE_MEMORY_PREDICATED) {
+                    PutBit(TRACE_STREAM_PRESENT, presentBit, pendingPresent[i]);
+                }
+            }
+        }
+
+        uint8_t* p = streamEnd[TRACE_STREAM_ADDRESSES];
+        for (uint32_t i = 0; i < bbl.memOps.size(); i++) {
+            bool present = pendingPresent[i] || !(bbl.memOps[i].flags & TRACE_MEMORY_PREDICATED);
+            if (present) {
+                uint64_t& last = lastAddress[bbl.firstMemOp + i];
+                p = PutVarint(p, ZigZag((int64_t) (pendingAddresses[i] - last)));
+                last = pendingAddresses[i];
+            }
+        }
+        streamEnd[TRACE_STREAM_ADDRESSES] = p;
+
+        if (bbl.branchKind == TRACE_BRANCH_CONDITIONAL) {
+            PutBit(TRACE_STREAM_TAKEN, takenBit, pendingTaken);
+        } else if (bbl.branchKind == TRACE_BRANCH_INDIRECT) {
+            uint64_t& last = lastTarget[pendingBbl];
+            streamEnd[TRACE_STREAM_TARGETS] = PutVarint(streamEnd[TRACE_STREAM_TARGETS], ZigZag((int64_t) (pendingTarget - last)));
+            last = pendingTarget;
+        }
+
+        blockRecords++;
+        pendingBbl = NO_BBL;
+    }
+
+    void PutBit(uint32_t stream, uint32_t& bit, bool value) {
+        if ((bit & 7) == 0) {
+            *streamEnd[stream]++ = 0;
+        }
+        streamEnd[stream][-1] |= (uint8_t) value << (bit & 7);
+        bit++;
+    }
+
+    // Lays the streams out behind their sizes and stores the payload
+    // compressed, or as it is when that is no smaller
+    void FlushBlock() {
+        if (blockRecords == 0) {
+            return;
+        }
+        TraceStreamSizes sizes;
+        uint8_t* p = &payload[sizeof(sizes)];
+        for (uint32_t s = 0; s < TRACE_STREAMS; s++) {
+            sizes.bytes[s] = streamEnd[s] - &streams[s][0];
+            memcpy(p, &streams[s][0], sizes.bytes[s]);
+            p += sizes.bytes[s];
+            streamEnd[s] = &streams[s][0];
+        }
+        memcpy(&payload[0], &sizes, sizeof(sizes));
+
+        TraceBlockHeader header;
+        header.bytes = p - &payload[0];
+        header.packedBytes = TraceCompress(&payload[0], header.bytes, &packed[0]);
+        header.records = blockRecords;
+        const uint8_t* data = &packed[0];
+        if (header.packedBytes >= header.bytes) {
+            header.packedBytes = header.bytes;
+            data = &payload[0];
+        }
+        Write(&header, sizeof(header));
+        Write(data, header.packedBytes);
+        presentBit = takenBit = 0;
+        blockRecords = 0;
+    }
+
+    void Write(const void* data, uint64_t bytes) {
+        if (fd < 0) {
+            return;
+        }
+        if (size + bytes > capacity) {
+            if (map != NULL) {
+                munmap(map, capacity);
+            }
+            capacity = ((size + bytes) / GROW_BYTES + 1) * GROW_BYTES;
+            map = NULL;
+            if (ftruncate(fd, capacity) == 0) {
+                void* mapped = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                map = (mapped == MAP_FAILED) ? NULL : (uint8_t*) mapped;
+            }
+            if (map == NULL) {
+                close(fd);
+                fd = -1;
+                return;
+            }
+        }
+        memcpy(map + size, data, bytes);
+        size += bytes;
+    }
+
+    int32_t fd;
+    uint8_t* map;
+    uint64_t capacity;
+    uint64_t size;
+
+    std::vector<uint8_t> streams[TRACE_STREAMS];
+    uint8_t* streamEnd[TRACE_STREAMS];
+    uint32_t presentBit; // bits used in the bit streams
+    uint32_t takenBit;
+    uint32_t blockRecords;
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> packed;
+
+    std::vector<const TraceBbl*> bbls; // this writer's view of the side table
+    uint32_t memOps;
+
+    uint32_t lastBbl;
+    std::vector<uint64_t> lastAddress; // per static memory operand
+    std::vector<uint64_t> lastTarget;  // per block
+
+    uint32_t pendingBbl;
+    bool pendingTaken;
+    uint64_t pendingTarget;
+    std::vector<uint64_t> pendingAddresses;
+    std::vector<uint8_t> pendingPresent;
+};
+
+#endif
@@ -0,0 +1,481 @@
+#ifndef TRACEFORMAT_H
+#define TRACEFORMAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * On-disk format of the binary instruction traces written by the -trace mode
+ * of HW1 and HW2 and read back by tracereader.h. Nothing here depends on Pin,
+ * so offline tools only need this header and the reader.
+ *
+ * A recording is a static side table, <prefix>.static, plus one trace per
+ * application thread, <prefix>.<tid>.trace. The side table describes every
+ * instrumented basic block once: its address, instruction sizes and Pin
+ * categories, its memory operands and how it ends. The trace is a header
+ * followed by framed blocks of at most TRACE_BLOCK_BYTES of payload. Each
+ * executed basic block adds one record, split over the payload's streams:
+ *
+ *   bbls       varint zigzag(bbl - previous bbl)
+ *   present    one bit per predicated memory operand, 1 if it executed
+ *   addresses  varint zigzag(ea - previous ea of the same operand), per
+ *              executed operand
+ *   taken      one bit per conditional branch, 1 if taken
+ *   targets    varint zigzag(target - previous target of the block), per
+ *              indirect branch
+ *
+ * Bit streams are packed LSB first. The payload is the byte length of each
+ * stream (TraceBlockHeader::streams) followed by the streams in that order,
+ * so a reader decodes every varint of a stream in one pass instead of
+ * interleaving them with the per-record control flow.
+ *
+ * The payload is then compressed with the LZ77 codec below and stored as
+ * `packedBytes` bytes; a block that does not shrink is stored as it is,
+ * with packedBytes == bytes. Deltas against the same static operand turn
+ * strided accesses into one-byte values and repeated loop iterations into
+ * repeated byte strings, which the codec folds into matches. Delta state
+ * carries across blocks, so blocks frame the stream for buffered reading
+ * but are not independently decodable.
+ *
+ * An operand has at most one address per record. A REP-prefixed string
+ * instruction that iterates without re-entering its block records the
+ * address of its first iteration only; replay sees one access there.
+ */
+const char TRACE_MAGIC[8] = {'H', 'W', 'T', 'R', 'A', 'C', 'E', '2'};
+const char TRACE_STATIC_MAGIC[8] = {'H', 'W', 'S', 'T', 'A', 'T', 'C', '2'};
+const uint32_t TRACE_BLOCK_BYTES = 1 << 16;
+
+enum TraceBranchKind : uint8_t {
+    TRACE_BRANCH_NONE,
+    TRACE_BRANCH_CONDITIONAL,
+    TRACE_BRANCH_INDIRECT
+};
+
+enum TraceMemoryFlags : uint8_t {
+    TRACE_MEMORY_READ = 1,
+    TRACE_MEMORY_WRITE = 2,
+    TRACE_MEMORY_PREDICATED = 4
+};
+
+struct TraceFileHeader {
+    char magic[8];
+    uint32_t blockBytes;
+    uint32_t thread;
+};
+
+enum TraceStream {
+    TRACE_STREAM_BBLS,
+    TRACE_STREAM_PRESENT,
+    TRACE_STREAM_ADDRESSES,
+    TRACE_STREAM_TAKEN,
+    TRACE_STREAM_TARGETS,
+    TRACE_STREAMS
+};
+
+struct TraceBlockHeader {
+    uint32_t bytes;       // payload, after decompression
+    uint32_t packedBytes; // stored in the file
+    uint32_t records;
+};
+
+// Start of every payload
+struct TraceStreamSizes {
+    uint32_t bytes[TRACE_STREAMS];
+};
+
+struct TraceMemOp {
+    uint16_t instruction; // index within the block
+    uint16_t size;
+    uint8_t flags;
+};
+
+struct TraceBbl {
+    uint64_t address;
+    uint32_t firstMemOp; // global index of the first operand, for per-operand delta state
+    uint32_t numPredicated;
+    uint8_t branchKind;
+    std::vector<uint8_t> sizes;       // per instruction
+    std::vector<uint16_t> categories; // per instruction, Pin's INS_Category
+    std::vector<TraceMemOp> memOps;
+};
+
+inline uint64_t ZigZag(int64_t value) { return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63); }
+inline int64_t UnZigZag(uint64_t value) { return (int64_t) (value >> 1) ^ -(int64_t) (value & 1); }
+
+inline uint8_t* PutVarint(uint8_t* p, uint64_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t) value | 0x80;
+        value >>= 7;
+    }
+    *p++ = (uint8_t) value;
+    return p;
+}
+
+inline const uint8_t* GetVarint(const uint8_t* p, uint64_t& value) {
+    uint64_t result = *p & 0x7f;
+    for (uint32_t shift = 7; *p++ & 0x80; shift += 7) {
+        result |= (uint64_t) (*p & 0x7f) << shift;
+    }
+    value = result;
+    return p;
+}
+
+// Decodes every varint in [p, end) into `out` and returns how many there
+// were, or ~0 if the last one is cut short. Eight one-byte values, the
+// common case for strided operands, are taken in a single step.
+inline uint32_t GetVarints(const uint8_t* p, const uint8_t* end, int64_t* out) {
+    int64_t* start = out;
+    while (p < end) {
+        uint64_t word;
+        if (end - p >= 8 && (memcpy(&word, p, sizeof(word)), (word & 0x8080808080808080ULL) == 0)) {
+            for (uint32_t i = 0; i < 8; i++) {
+                out[i] = UnZigZag(p[i]);
+            }
+            p += 8;
+            out += 8;
+            continue;
+        }
+        uint64_t value = 0;
+        uint8_t byte;
+        uint32_t shift = 0;
+        do {
+            if (p == end || shift > 63) {
+                return ~0U;
+            }
+            byte = *p++;
+            value |= (uint64_t) (byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        *out++ = UnZigZag(value);
+    }
+    return out - start;
+}
+
+// Upper bound on the encoded size of one record of `bbl`, over all streams
+inline uint32_t TraceRecordBound(const TraceBbl& bbl) { return 10 + (bbl.numPredicated + 7) / 8 + 10 * bbl.memOps.size() + 10; }
+
+/*
+ * LZ77 block codec with the sequence layout of LZ4 blocks. Each sequence is
+ * a token byte, whose high nibble is the literal length and low nibble the
+ * match length minus TRACE_MIN_MATCH, then the literals, then the match
+ * offset as two bytes little endian. A nibble of 15 is continued by bytes
+ * that are added to it until one is below 255. The last sequence has
+ * literals only. Offsets fit 16 bits because payloads stay under 64 KiB.
+ */
+const uint32_t TRACE_MIN_MATCH = 4;
+const uint32_t TRACE_HASH_BITS = 13;
+const uint32_t TRACE_COPY_SLACK = 8; // decompression may write this far past the end
+
+inline uint32_t TraceCompressBound(uint32_t bytes) { return bytes + bytes / 255 + 16; }
+
+inline uint32_t TraceLoad32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint8_t* TracePutLength(uint8_t* p, uint32_t length) {
+    for (; length >= 255; length -= 255) {
+        *p++ = 255;
+    }
+    *p++ = (uint8_t) length;
+    return p;
+}
+
+inline uint8_t* TracePutSequence(uint8_t* out, const uint8_t* literals, uint32_t numLiterals, uint32_t offset, uint32_t match) {
+    uint8_t* token = out++;
+    *token = (uint8_t) (std::min<uint32_t>(numLiterals, 15) << 4);
+    if (numLiterals >= 15) {
+        out = TracePutLength(out, numLiterals - 15);
+    }
+    memcpy(out, literals, numLiterals);
+    out += numLiterals;
+    if (offset == 0) {
+        return out; // last sequence
+    }
+    *out++ = (uint8_t) offset;
+    *out++ = (uint8_t) (offset >> 8);
+    match -= TRACE_MIN_MATCH;
+    *token |= (uint8_t) std::min<uint32_t>(match, 15);
+    if (match >= 15) {
+        out = TracePutLength(out, match - 15);
+    }
+    return out;
+}
+
+// Compresses `bytes` (at most 64 KiB) of `src` into `dst`, which holds
+// TraceCompressBound(bytes), and returns the compressed size
+inline uint32_t TraceCompress(const uint8_t* src, uint32_t bytes, uint8_t* dst) {
+    uint32_t table[1 << TRACE_HASH_BITS];
+    std::fill(table, table + (1 << TRACE_HASH_BITS), 0);
+    const uint8_t* end = src + bytes;
+    const uint8_t* anchor = src;
+    const uint8_t* p = src + 1;
+    uint8_t* out = dst;
+    // Leaves room to compare eight bytes at a time
+    while (bytes >= 16 && p + 8 + TRACE_MIN_MATCH <= end) {
+        uint32_t sequence = TraceLoad32(p);
+        uint32_t hash = (sequence * 2654435761U) >> (32 - TRACE_HASH_BITS);
+        const uint8_t* ref = src + table[hash];
+        table[hash] = p - src;
+        if (ref >= p || p - ref > 0xffff || TraceLoad32(ref) != sequence) {
+            p += 1 + ((p - anchor) >> 6); // skips faster through data that does not compress
+            continue;
+        }
+        while (p > anchor && ref > src && p[-1] == ref[-1]) {
+            p--;
+            ref--;
+        }
+        const uint8_t* q = p + TRACE_MIN_MATCH;
+        const uint8_t* r = ref + TRACE_MIN_MATCH;
+        while (q + 8 <= end) {
+            uint64_t a, b;
+            memcpy(&a, q, sizeof(a));
+            memcpy(&b, r, sizeof(b));
+            if (a != b) {
+                uint32_t same = __builtin_ctzll(a ^ b) >> 3;
+                q += same;
+                r += same;
+                break;
+            }
+            q += 8;
+            r += 8;
+        }
+        while (q + 8 > end && q < end && *q == *r) {
+            q++;
+            r++;
+        }
+        out = TracePutSequence(out, anchor, p - anchor, p - ref, q - p);
+        p = anchor = q;
+    }
+    return TracePutSequence(out, anchor, end - anchor, 0, 0) - dst;
+}
+
+inline bool TraceGetLength(const uint8_t*& p, const uint8_t* end, uint32_t& length) {
+    uint8_t byte;
+    do {
+        if (p == end) {
+            return false;
+        }
+        byte = *p++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Restores exactly `bytes` into `dst`, which has TRACE_COPY_SLACK bytes
+// of room past them; false on malformed input
+inline bool TraceDecompress(const uint8_t* src, uint32_t packedBytes, uint8_t* dst, uint32_t bytes) {
+    const uint8_t* end = src + packedBytes;
+    uint8_t* out = dst;
+    uint8_t* outEnd = dst + bytes;
+    while (src < end) {
+        uint32_t token = *src++;
+        uint32_t numLiterals = token >> 4;
+        if (numLiterals == 15 && !TraceGetLength(src, end, numLiterals)) {
+            return false;
+        }
+        if (numLiterals > (size_t) (end - src) || numLiterals > (size_t) (outEnd - out)) {
+            return false;
+        }
+        memcpy(out, src, numLiterals);
+        out += numLiterals;
+        src += numLiterals;
+        if (src == end) {
+            break;
+        }
+        if (end - src < 2) {
+            return false;
+        }
+        uint32_t offset = src[0] | (uint32_t) src[1] << 8;
+        src += 2;
+        uint32_t match = token & 15;
+        if (match == 15 && !TraceGetLength(src, end, match)) {
+            return false;
+        }
+        match += TRACE_MIN_MATCH;
+        if (offset == 0 || offset > (size_t) (out - dst) || match > (size_t) (outEnd - out)) {
+            return false;
+        }
+        const uint8_t* ref = out - offset;
+        if (offset >= 8) {
+            for (uint32_t i = 0; i < match; i += 8) {
+                memcpy(out + i, ref + i, 8);
+            }
+        } else {
+            for (uint32_t i = 0; i < match; i++) {
+                out[i] = ref[i];
+            }
+        }
+        out += match;
+    }
+    return out == outEnd;
+}
+
+// Same instructions, operands and ending, so records of one decode the other
+inline bool SameShape(const TraceBbl& a, const TraceBbl& b) {
+    if (a.address != b.address || a.branchKind != b.branchKind || a.sizes != b.sizes || a.categories != b.categories
+        || a.memOps.size() != b.memOps.size()) {
+        return false;
+    }
+    for (uint32_t i = 0; i < a.memOps.size(); i++) {
+        if (a.memOps[i].instruction != b.memOps[i].instruction || a.memOps[i].size != b.memOps[i].size
+            || a.memOps[i].flags != b.memOps[i].flags) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class TraceStaticTable {
+  public:
+    TraceStaticTable() : memOps(0) {}
+
+    // Returns the id of `bbl`. Pin instruments a block again when its code
+    // cache entry is flushed or it is reached through another trace; those
+    // copies reuse the first id, so only a block whose code changed gets a
+    // new one.
+    uint32_t Add(TraceBbl& bbl) {
+        auto range = byAddress.equal_range(bbl.address);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (SameShape(bbls[it->second], bbl)) {
+                bbl.firstMemOp = bbls[it->second].firstMemOp;
+                return it->second;
+            }
+        }
+        return Append(bbl);
+    }
+
+    // Entries never move, so recording threads keep pointers to them while
+    // other threads add blocks
+    uint32_t Size() const { return bbls.size(); }
+    uint32_t MemOps() const { return memOps; }
+    const TraceBbl& operator[](uint32_t id) const { return bbls[id]; }
+
+    // Fields are stored one by one, little endian and unpadded:
+    //   magic, u32 count, then per block: u64 address, u8 branchKind,
+    //   u32 numIns, u32 numMemOps, u8 sizes[numIns], u16 categories[numIns],
+    //   and per memory operand u16 instruction, u16 size, u8 flags
+    bool Write(const char* path) const {
+        FILE* file = fopen(path, "wb");
+        if (file == NULL) {
+            return false;
+        }
+        std::vector<uint8_t> out(TRACE_STATIC_MAGIC, TRACE_STATIC_MAGIC + sizeof(TRACE_STATIC_MAGIC));
+        PutField<uint32_t>(out, bbls.size());
+        for (const TraceBbl& bbl : bbls) {
+            PutField<uint64_t>(out, bbl.address);
+            PutField<uint8_t>(out, bbl.branchKind);
+            PutField<uint32_t>(out, bbl.sizes.size());
+            PutField<uint32_t>(out, bbl.memOps.size());
+            for (uint8_t size : bbl.sizes) {
+                PutField<uint8_t>(out, size);
+            }
+            for (uint16_t category : bbl.categories) {
+                PutField<uint16_t>(out, category);
+            }
+            for (const TraceMemOp& memOp : bbl.memOps) {
+                PutField<uint16_t>(out, memOp.instruction);
+                PutField<uint16_t>(out, memOp.size);
+                PutField<uint8_t>(out, memOp.flags);
+            }
+        }
+        bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+        return fclose(file) == 0 && ok;
+    }
+
+    bool Read(const char* path) {
+        FILE* file = fopen(path, "rb");
+        if (file == NULL) {
+            return false;
+        }
+        std::vector<uint8_t> in;
+        uint8_t chunk[1 << 16];
+        for (size_t n; (n = fread(chunk, 1, sizeof(chunk), file)) > 0;) {
+            in.insert(in.end(), chunk, chunk + n);
+        }
+        fclose(file);
+
+        bbls.clear();
+        byAddress.clear();
+        memOps = 0;
+        const uint8_t* p = in.data();
+        const uint8_t* end = p + in.size();
+        uint32_t count = 0;
+        if ((size_t) (end - p) < sizeof(TRACE_STATIC_MAGIC) || memcmp(p, TRACE_STATIC_MAGIC, sizeof(TRACE_STATIC_MAGIC)) != 0) {
+            return false;
+        }
+        p += sizeof(TRACE_STATIC_MAGIC);
+        if (!GetField(p, end, count)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            TraceBbl bbl;
+            uint32_t numIns = 0;
+            uint32_t numMemOps = 0;
+            if (!GetField(p, end, bbl.address) || !GetField(p, end, bbl.branchKind) || !GetField(p, end, numIns)
+                || !GetField(p, end, numMemOps) || (uint64_t) numIns * 3 + (uint64_t) numMemOps * 5 > (uint64_t) (end - p)) {
+                return false;
+            }
+            bbl.sizes.resize(numIns);
+            bbl.categories.resize(numIns);
+            bbl.memOps.resize(numMemOps);
+            bbl.numPredicated = 0;
+            for (uint32_t j = 0; j < numIns; j++) {
+                GetField(p, end, bbl.sizes[j]);
+            }
+            for (uint32_t j = 0; j < numIns; j++) {
+                GetField(p, end, bbl.categories[j]);
+            }
+            for (TraceMemOp& memOp : bbl.memOps) {
+                GetField(p, end, memOp.instruction);
+                GetField(p, end, memOp.size);
+                GetField(p, end, memOp.flags);
+                bbl.numPredicated += (memOp.flags & TRACE_MEMORY_PREDICATED) != 0;
+            }
+            Append(bbl); // ids in the traces are positions in the file
+        }
+        return true;
+    }
+
+  private:
+    template <typename Field>
+    static void PutField(std::vector<uint8_t>& out, uint64_t value) {
+        for (uint32_t i = 0; i < sizeof(Field); i++) {
+            out.push_back((uint8_t) (value >> (8 * i)));
+        }
+    }
+
+    template <typename Field>
+    static bool GetField(const uint8_t*& p, const uint8_t* end, Field& value) {
+        if ((size_t) (end - p) < sizeof(Field)) {
+            return false;
+        }
+        uint64_t result = 0;
+        for (uint32_t i = 0; i < sizeof(Field); i++) {
+            result |= (uint64_t) p[i] << (8 * i);
+        }
+        value = (Field) result;
+        p += sizeof(Field);
+        return true;
+    }
+
+    uint32_t Append(TraceBbl& bbl) {
+        bbl.firstMemOp = memOps;
+        memOps += bbl.memOps.size();
+        bbls.push_back(bbl);
+        byAddress.emplace(bbl.address, bbls.size() - 1);
+        return bbls.size() - 1;
+    }
+
+    std::deque<TraceBbl> bbls;
+    std::unordered_multimap<uint64_t, uint32_t> byAddress;
+    uint32_t memOps;
+};
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef TRACEREADER_H
+#define TRACEREADER_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include "traceformat.h"
+
+/*
+ * Streams back one thread's trace written by tracewriter.h. Needs no Pin:
+ *
+ *     TraceStaticTable table;
+ *     table.Read("run.static");
+ *     TraceReader reader;
+ *     reader.Open("run.0.trace", &table);
+ *     TraceRecord record;
+ *     while (reader.Next(record)) {
+ *         ... record.bbl->address, record.addresses[i], record.taken ...
+ *     }
+ *
+ * The file is memory-mapped with sequential access advice. Each block is
+ * decompressed once and its varint streams are decoded in one pass each,
+ * into arrays that Next() then walks record by record. For each record,
+ * addresses[i] belongs to bbl->memOps[i]; predicated operands that did not
+ * execute have present[i] == 0 and a stale address.
+ */
+struct TraceRecord {
+    uint32_t id;
+    const TraceBbl* bbl;
+    const uint64_t* addresses;
+    const uint8_t* present;
+    bool taken;      // conditional branches
+    uint64_t target; // indirect branches
+};
+
+class TraceReader {
+  public:
+    TraceReader()
+        : map(NULL), size(0), p(NULL), end(NULL), table(NULL), lastBbl(0), maxMemOps(0), presentDirty(false), blockRecords(0), next(0),
+          numDeltas(0), nextDelta(0), numTargets(0), nextTarget(0), presentData(NULL), presentBits(0), presentBit(0),
+          takenData(NULL), takenBits(0), takenBit(0) {}
+    ~TraceReader() { Close(); }
+
+    bool Open(const char* path, const TraceStaticTable* staticTable) {
+        Close();
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(TraceFileHeader)) {
+            close(fd);
+            return false;
+        }
+        void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        map = (const uint8_t*) mapped;
+        size = st.st_size;
+        madvise(mapped, size, MADV_SEQUENTIAL);
+
+        memcpy(&header, map, sizeof(header));
+        if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+            Close();
+            return false;
+        }
+        table = staticTable;
+        p = map + sizeof(header);
+        end = map + size;
+        lastBbl = 0;
+        blockRecords = next = 0;
+        numDeltas = nextDelta = numTargets = nextTarget = 0;
+        lastAddress.assign(table->MemOps(), 0);
+        lastTarget.assign(table->Size(), 0);
+        maxMemOps = 0;
+        bbls.resize(table->Size());
+        for (uint32_t id = 0; id < table->Size(); id++) {
+            const TraceBbl& bbl = (*table)[id];
+            bbls[id].bbl = &bbl;
+            bbls[id].firstMemOp = bbl.firstMemOp;
+            bbls[id].numMemOps = bbl.memOps.size();
+            bbls[id].numPredicated = bbl.numPredicated;
+            bbls[id].branchKind = bbl.branchKind;
+            maxMemOps = std::max<uint32_t>(maxMemOps, bbl.memOps.size());
+        }
+        addresses.assign(maxMemOps, 0);
+        present.assign(maxMemOps, 1);
+        // A varint takes at least one byte; one record may read past the
+        // last delta into the zero padding before it is found short
+        payload.resize(sizeof(TraceStreamSizes) + TRACE_BLOCK_BYTES + TRACE_COPY_SLACK);
+        ids.resize(TRACE_BLOCK_BYTES);
+        deltas.resize(TRACE_BLOCK_BYTES + maxMemOps);
+        targets.resize(TRACE_BLOCK_BYTES + 1);
+        return true;
+    }
+
+    uint32_t Thread() const { return header.thread; }
+
+    bool Next(TraceRecord& record) {
+        if (next == blockRecords && !NextBlock()) {
+            return false;
+        }
+        if (nextDelta > numDeltas || nextTarget > numTargets) {
+            return Corrupt();
+        }
+
+        uint32_t id = ids[next++];
+        const BblInfo& bbl = bbls[id];
+        uint32_t numMemOps = bbl.numMemOps;
+
+        if (bbl.numPredicated) {
+            if (presentBit + bbl.numPredicated > presentBits) {
+                return Corrupt();
+            }
+            presentDirty = true;
+            for (uint32_t i = 0; i < numMemOps; i++) {
+                if (bbl.bbl->memOps[i].flags & TRACE_MEMORY_PREDICATED) {
+                    present[i] = (presentData[presentBit >> 3] >> (presentBit & 7)) & 1;
+                    presentBit++;
+                } else {
+                    present[i] = 1;
+                }
+            }
+        } else if (presentDirty) {
+            std::fill(present.begin(), present.end(), 1);
+            presentDirty = false;
+        }
+
+        uint64_t* last = &lastAddress[bbl.firstMemOp];
+        const int64_t* delta = &deltas[nextDelta];
+        if (bbl.numPredicated == 0) {
+            for (uint32_t i = 0; i < numMemOps; i++) {
+                last[i] += delta[i];
+                addresses[i] = last[i];
+            }
+            nextDelta += numMemOps;
+        } else {
+            uint32_t used = 0;
+            for (uint32_t i = 0; i < numMemOps; i++) {
+                if (present[i]) {
+                    last[i] += delta[used++];
+                    addresses[i] = last[i];
+                }
+            }
+            nextDelta += used;
+        }
+
+        record.taken = false;
+        record.target = 0;
+        if (bbl.branchKind == TRACE_BRANCH_CONDITIONAL) {
+            if (takenBit >= takenBits) {
+                return Corrupt();
+            }
+            record.taken = (takenData[takenBit >> 3] >> (takenBit & 7)) & 1;
+            takenBit++;
+        } else if (bbl.branchKind == TRACE_BRANCH_INDIRECT) {
+            lastTarget[id] += targets[nextTarget++];
+            record.target = lastTarget[id];
+            record.taken = true;
+        }
+
+        record.id = id;
+        record.bbl = bbl.bbl;
+        record.addresses = addresses.data();
+        record.present = present.data();
+        return true;
+    }
+
+    void Close() {
+        if (map != NULL) {
+            munmap((void*) map, size);
+            map = NULL;
+        }
+    }
+
+  private:
+    // What Next() needs of a side table entry, packed together
+    struct BblInfo {
+        const TraceBbl* bbl;
+        uint32_t firstMemOp;
+        uint32_t numMemOps;
+        uint32_t numPredicated;
+        uint32_t branchKind;
+    };
+
+    // Unpacks the next block and decodes its streams
+    bool NextBlock() {
+        if (nextDelta != numDeltas || nextTarget != numTargets) {
+            return Corrupt(); // the records did not use up the block
+        }
+        if (p + sizeof(TraceBlockHeader) > end) {
+            return false;
+        }
+        TraceBlockHeader block;
+        memcpy(&block, p, sizeof(block));
+        if (block.records == 0 || block.bytes < sizeof(TraceStreamSizes) || block.bytes > payload.size() - TRACE_COPY_SLACK
+            || block.packedBytes > block.bytes || p + sizeof(block) + block.packedBytes > end) {
+            return Corrupt(); // zero padding or a truncated file
+        }
+        p += sizeof(block);
+        const uint8_t* data = p;
+        if (block.packedBytes < block.bytes) {
+            if (!TraceDecompress(p, block.packedBytes, &payload[0], block.bytes)) {
+                return Corrupt();
+            }
+            data = &payload[0];
+        }
+        p += block.packedBytes;
+
+        TraceStreamSizes sizes;
+        memcpy(&sizes, data, sizeof(sizes));
+        const uint8_t* stream[TRACE_STREAMS + 1];
+        stream[0] = data + sizeof(sizes);
+        for (uint32_t s = 0; s < TRACE_STREAMS; s++) {
+            if (sizes.bytes[s] > (size_t) (data + block.bytes - stream[s])) {
+                return Corrupt();
+            }
+            stream[s + 1] = stream[s] + sizes.bytes[s];
+        }
+
+        // Block ids go through the delta array before it holds addresses
+        if (block.records > sizes.bytes[TRACE_STREAM_BBLS]
+            || GetVarints(stream[TRACE_STREAM_BBLS], stream[TRACE_STREAM_BBLS + 1], &deltas[0]) != block.records) {
+            return Corrupt();
+        }
+        for (uint32_t r = 0; r < block.records; r++) {
+            lastBbl += (uint32_t) deltas[r];
+            if (lastBbl >= table->Size()) {
+                return Corrupt(); // or a mismatched side table
+            }
+            ids[r] = lastBbl;
+        }
+
+        numDeltas = GetVarints(stream[TRACE_STREAM_ADDRESSES], stream[TRACE_STREAM_ADDRESSES + 1], &deltas[0]);
+        numTargets = GetVarints(stream[TRACE_STREAM_TARGETS], stream[TRACE_STREAM_TARGETS + 1], &targets[0]);
+        if (numDeltas == ~0U || numTargets == ~0U) {
+            return Corrupt();
+        }
+        std::fill(deltas.begin() + numDeltas, deltas.begin() + numDeltas + maxMemOps, 0);
+        targets[numTargets] = 0;
+
+        presentData = stream[TRACE_STREAM_PRESENT];
+        presentBits = 8 * sizes.bytes[TRACE_STREAM_PRESENT];
+        takenData = stream[TRACE_STREAM_TAKEN];
+        takenBits = 8 * sizes.bytes[TRACE_STREAM_TAKEN];
+        presentBit = takenBit = 0;
+        nextDelta = nextTarget = 0;
+        blockRecords = block.records;
+        next = 0;
+        return true;
+    }
+
+    // Stops the replay for good
+    bool Corrupt() {
+        p = end;
+        blockRecords = next = 0;
+        numDeltas = nextDelta = numTargets = nextTarget = 0;
+        return false;
+    }
+
+    const uint8_t* map;
+    size_t size;
+    TraceFileHeader header;
+    const uint8_t* p;
+    const uint8_t* end;
+    const TraceStaticTable* table;
+    std::vector<BblInfo> bbls;
+    uint32_t lastBbl;
+    uint32_t maxMemOps;
+    bool presentDirty; // a predicated record cleared some present[] entries
+    std::vector<uint64_t> lastAddress;
+    std::vector<uint64_t> lastTarget;
+    std::vector<uint64_t> addresses;
+    std::vector<uint8_t> present;
+
+    // The current block, decoded
+    std::vector<uint8_t> payload;
+    uint32_t blockRecords;
+    uint32_t next;
+    std::vector<uint32_t> ids;
+    std::vector<int64_t> deltas;
+    uint32_t numDeltas;
+    uint32_t nextDelta;
+    std::vector<int64_t> targets;
+    uint32_t numTargets;
+    uint32_t nextTarget;
+    const uint8_t* presentData;
+    uint32_t presentBits;
+    uint32_t presentBit;
+    const uint8_t* takenData;
+    uint32_t takenBits;
+    uint32_t takenBit;
+};
+
+#endif
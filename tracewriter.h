@@ -0,0 +1,167 @@
+#ifndef TRACEWRITER_H
+#define TRACEWRITER_H
+
+#include <stddef.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "traceencoder.h"
+
+/*
+ * Binary trace recording for the -trace mode of HW1 and HW2; the format is
+ * described in traceformat.h.
+ *
+ * Instrumentation writes fixed-size raw TraceEntry records into a
+ * per-thread Pin trace buffer. When a buffer fills, its entries are handed
+ * to the thread's TraceFileWriter (traceencoder.h).
+ *
+ * The side table is shared and grows as blocks are instrumented. Each
+ * writer keeps its own list of pointers into it, caught up under the
+ * recorder's lock when a buffer fills, and encodes from that list without
+ * the lock, so threads only serialize on the catch-up.
+ */
+static_assert(offsetof(TraceEntry, taken) >= offsetof(TraceEntry, kind) + sizeof(UINT32), "storing kind must not overwrite taken");
+static_assert(sizeof(((TraceEntry*) 0)->taken) == sizeof(BOOL), "taken is filled from IARG_BRANCH_TAKEN");
+
+// Tool-wide recorder: the side table, the trace buffer and one writer per thread
+class TraceRecorder {
+  public:
+    TraceRecorder() : buffer(BUFFER_ID_INVALID) {}
+
+    BOOL Open(const std::string& outputPrefix, UINT32 bufferPages) {
+        PIN_InitLock(&lock);
+        prefix = outputPrefix;
+        buffer = PIN_DefineTraceBuffer(sizeof(TraceEntry), bufferPages, BufferFull, this);
+        return buffer != BUFFER_ID_INVALID;
+    }
+
+    BOOL Enabled() const { return buffer != BUFFER_ID_INVALID; }
+
+    // Records every execution of `bbl`. With an `ifCall` taking the thread id,
+    // the entries are only written while it returns non-zero.
+    VOID InstrumentBbl(BBL bbl, AFUNPTR ifCall) {
+        TraceBbl info;
+        info.address = BBL_Address(bbl);
+        info.numPredicated = 0;
+        info.branchKind = TRACE_BRANCH_NONE;
+        UINT32 i = 0;
+        for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins), i++) {
+            info.sizes.push_back(INS_Size(ins));
+            info.categories.push_back(INS_Category(ins));
+            for (UINT32 memOp = 0; memOp < INS_MemoryOperandCount(ins); memOp++) {
+                TraceMemOp op;
+                op.instruction = i;
+                op.size = INS_MemoryOperandSize(ins, memOp);
+                op.flags = (INS_MemoryOperandIsRead(ins, memOp) ? TRACE_MEMORY_READ : 0)
+                           | (INS_MemoryOperandIsWritten(ins, memOp) ? TRACE_MEMORY_WRITE : 0)
+                           | (INS_IsPredicated(ins) ? TRACE_MEMORY_PREDICATED : 0);
+                info.numPredicated += INS_IsPredicated(ins);
+                info.memOps.push_back(op);
+            }
+        }
+        INS tail = BBL_InsTail(bbl);
+        if (INS_IsIndirectControlFlow(tail)) {
+            info.branchKind = TRACE_BRANCH_INDIRECT;
+        } else if (INS_IsBranch(tail) && INS_HasFallThrough(tail)) {
+            info.branchKind = TRACE_BRANCH_CONDITIONAL;
+        }
+
+        // Writers catch up with the table under the same lock
+        PIN_GetLock(&lock, PIN_ThreadId() + 1);
+        UINT32 id = table.Add(info);
+        PIN_ReleaseLock(&lock);
+
+        INS head = BBL_InsHead(bbl);
+        if (ifCall != NULL) {
+            INS_InsertIfCall(head, IPOINT_BEFORE, ifCall, IARG_THREAD_ID, IARG_END);
+            INS_InsertFillBufferThen(head, IPOINT_BEFORE, buffer,
+                IARG_UINT32, id, offsetof(TraceEntry, id),
+                IARG_UINT32, (UINT32) TRACE_ENTRY_BBL, offsetof(TraceEntry, kind),
+                IARG_END);
+        } else {
+            INS_InsertFillBuffer(head, IPOINT_BEFORE, buffer,
+                IARG_UINT32, id, offsetof(TraceEntry, id),
+                IARG_UINT32, (UINT32) TRACE_ENTRY_BBL, offsetof(TraceEntry, kind),
+                IARG_END);
+        }
+
+        UINT32 index = 0;
+        for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+            for (UINT32 memOp = 0; memOp < INS_MemoryOperandCount(ins); memOp++, index++) {
+                if (ifCall != NULL) {
+                    INS_InsertIfPredicatedCall(ins, IPOINT_BEFORE, ifCall, IARG_THREAD_ID, IARG_END);
+                    INS_InsertFillBufferThen(ins, IPOINT_BEFORE, buffer,
+                        IARG_MEMORYOP_EA, memOp, offsetof(TraceEntry, value),
+                        IARG_UINT32, index, offsetof(TraceEntry, id),
+                        IARG_UINT32, (UINT32) TRACE_ENTRY_MEMORY, offsetof(TraceEntry, kind),
+                        IARG_END);
+                } else {
+                    INS_InsertFillBufferPredicated(ins, IPOINT_BEFORE, buffer,
+                        IARG_MEMORYOP_EA, memOp, offsetof(TraceEntry, value),
+                        IARG_UINT32, index, offsetof(TraceEntry, id),
+                        IARG_UINT32, (UINT32) TRACE_ENTRY_MEMORY, offsetof(TraceEntry, kind),
+                        IARG_END);
+                }
+            }
+        }
+
+        if (info.branchKind != TRACE_BRANCH_NONE) {
+            if (ifCall != NULL) {
+                INS_InsertIfCall(tail, IPOINT_BEFORE, ifCall, IARG_THREAD_ID, IARG_END);
+                INS_InsertFillBufferThen(tail, IPOINT_BEFORE, buffer,
+                    IARG_BRANCH_TARGET_ADDR, offsetof(TraceEntry, value),
+                    IARG_BRANCH_TAKEN, offsetof(TraceEntry, taken),
+                    IARG_UINT32, (UINT32) TRACE_ENTRY_BRANCH, offsetof(TraceEntry, kind),
+                    IARG_END);
+            } else {
+                INS_InsertFillBuffer(tail, IPOINT_BEFORE, buffer,
+                    IARG_BRANCH_TARGET_ADDR, offsetof(TraceEntry, value),
+                    IARG_BRANCH_TAKEN, offsetof(TraceEntry, taken),
+                    IARG_UINT32, (UINT32) TRACE_ENTRY_BRANCH, offsetof(TraceEntry, kind),
+                    IARG_END);
+            }
+        }
+    }
+
+    // Finishes every thread's file and writes the side table
+    VOID Close() {
+        PIN_GetLock(&lock, 0);
+        for (TraceFileWriter* writer : writers) {
+            if (writer != NULL) {
+                writer->Sync(table);
+                writer->Close();
+            }
+        }
+        table.Write((prefix + ".static").c_str());
+        PIN_ReleaseLock(&lock);
+    }
+
+  private:
+    static VOID* BufferFull(BUFFER_ID id, THREADID tid, const CONTEXT* ctxt, VOID* buffer, UINT64 numElements, VOID* v) {
+        TraceRecorder* recorder = (TraceRecorder*) v;
+        PIN_GetLock(&recorder->lock, tid + 1);
+        if ((UINT32) tid >= recorder->writers.size()) {
+            recorder->writers.resize(tid + 1, NULL);
+        }
+        if (recorder->writers[tid] == NULL) {
+            std::ostringstream path;
+            path << recorder->prefix << "." << tid << ".trace";
+            recorder->writers[tid] = new TraceFileWriter(path.str(), tid);
+        }
+        TraceFileWriter* writer = recorder->writers[tid];
+        writer->Sync(recorder->table);
+        PIN_ReleaseLock(&recorder->lock);
+
+        // Only this thread touches its writer
+        writer->Append((const TraceEntry*) buffer, numElements);
+        return buffer;
+    }
+
+    std::string prefix;
+    BUFFER_ID buffer;
+    PIN_LOCK lock;
+    TraceStaticTable table;
+    std::vector<TraceFileWriter*> writers;
+};
+
+#endif
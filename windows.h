@@ -0,0 +1,96 @@
+#ifndef WINDOWS_H
+#define WINDOWS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Analysis windows shared by HW1 and HW2, in instructions from the start of
+ * the run. Three ways to describe them, in order of precedence:
+ *
+ *   -windows start:length,...   an explicit list ("2e9:5e8,1e10:1e9")
+ *   -every N                    from -f onwards, a window every N instructions
+ *   (neither)                   the single window after -f
+ *
+ * Windows without an explicit length use -window_length. Explicit lists are
+ * sorted by start; a window whose start has already passed begins as soon as
+ * the previous one ends and keeps its full length, so Start() and End() give
+ * the bounds actually used.
+ */
+class WindowSchedule {
+  public:
+    WindowSchedule() : index(0), every(0), length(0), first(0), start(0), end(0) {}
+
+    // Returns false with a message in `error` when the list does not parse
+    BOOL Init(UINT64 fastForward, UINT64 windowLength, UINT64 everyN, const std::string& list, std::string& error) {
+        length = windowLength;
+        first = fastForward;
+        every = list.empty() ? everyN : 0;
+        if (length == 0) {
+            error = "window length must be positive";
+            return false;
+        }
+        std::istringstream items(list);
+        for (std::string item; std::getline(items, item, ',');) {
+            const char* text = item.c_str();
+            char* parsed;
+            double itemStart = strtod(text, &parsed);
+            double itemLength = length;
+            BOOL valid = parsed != text;
+            if (valid && *parsed == ':') {
+                text = parsed + 1;
+                itemLength = strtod(text, &parsed);
+                valid = parsed != text;
+            }
+            if (!valid || *parsed != '\0' || !std::isfinite(itemStart) || !std::isfinite(itemLength) || itemStart < 0 || itemLength < 1 ||
+                itemStart + itemLength >= 1.8e19) {
+                error = "malformed window \"" + item + "\", expected start[:length] with start >= 0 and length >= 1";
+                return false;
+            }
+            windows.push_back(std::make_pair((UINT64) itemStart, (UINT64) itemLength));
+        }
+        std::sort(windows.begin(), windows.end());
+        if (windows.empty() && every == 0) {
+            windows.push_back(std::make_pair(first, length));
+        }
+        start = NominalStart();
+        end = start + Length();
+        return true;
+    }
+
+    UINT32 Index() const { return index; }
+    BOOL Multiple() const { return every != 0 || windows.size() > 1; }
+
+    UINT64 Start() const { return start; }
+    UINT64 End() const { return end; }
+
+    // Moves on to the next window; false when there is none
+    BOOL Next() {
+        if (!every && index + 1 >= windows.size()) {
+            return false;
+        }
+        index++;
+        start = std::max(NominalStart(), end);
+        end = start + Length();
+        return true;
+    }
+
+  private:
+    UINT64 NominalStart() const { return every ? first + index * every : windows[index].first; }
+    UINT64 Length() const { return every ? length : windows[index].second; }
+
+    UINT32 index;
+    UINT64 every;
+    UINT64 length;
+    UINT64 first;
+    UINT64 start; // bounds of the current window
+    UINT64 end;
+    std::vector<std::pair<UINT64, UINT64> > windows; // (start, length)
+};
+
+#endif